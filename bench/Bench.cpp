@@ -0,0 +1,26 @@
+#include "Bench.h"
+#include <iostream>
+#include <string>
+using namespace std;
+
+double Bench::secondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Runs the benchmarks: bench [all | fat | compression]
+int main(int argc, char* argv[])
+{
+    string which = argc > 1 ? argv[1] : "all";
+    bool all = which == "all";
+    if (!all && which != "fat" && which != "compression")
+    {
+        cout << "Usage: bench [all | fat | compression]\n";
+        return 1;
+    }
+    if (all || which == "fat")
+        Bench::fatCodec();
+    if (all || which == "compression")
+        Bench::compression(4096, 8192);
+    return 0;
+}
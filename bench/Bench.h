@@ -0,0 +1,19 @@
+#pragma once
+#include <chrono>
+using namespace std;
+
+/** Benchmarks run by the bench program (see Bench.cpp for its arguments); each prints a table of its own. */
+class Bench
+{
+public:
+    /** Encodes and decodes FATs of a few sizes through the per-entry codec Converter used to have, which built a
+        4-byte vector for every entry, and through its bulk little-endian codec; reports MB/s and the speed-up. */
+    static void fatCodec();
+
+    /** Formats a plain and a compressed image of 'clusterCount' clusters of 'clusterSize' bytes, imports and exports a
+        text-like and an incompressible file through the shell commands on each, and reports the ratio and MB/s. */
+    static void compression(int clusterSize, int clusterCount);
+
+    /** Seconds elapsed since 'start'. */
+    static double secondsSince(chrono::steady_clock::time_point start);
+};
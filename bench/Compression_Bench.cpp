@@ -0,0 +1,122 @@
+#include "Bench.h"
+#include "CommandProcessor.h"
+#include "Dedup_Table.h"
+#include "Mini_FAT.h"
+#include "Mounted_Tree.h"
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// 8.3 names, since the imported file keeps the name of its source
+static const char* DISK_PATH = "benchdsk.bin";
+static const char* SOURCE_PATH = "benchsrc.bin";
+static const char* EXPORT_PATH = "benchout.bin";
+
+// Text-like data: words drawn from a small vocabulary, so about what a document or a log compresses to
+static vector<char> textData(size_t length)
+{
+    static const char* words[] = { "cluster", "directory", "entry", "the", "of", "file", "disk", "a", "table",
+        "record", "frame", "and", "volume", "size", "to", "name", "in", "block", "free", "chain" };
+    vector<char> data;
+    data.reserve(length);
+    uint32_t state = 12345;
+    while (data.size() < length)
+    {
+        state = state * 1664525 + 1013904223;
+        const char* word = words[(state >> 16) % size(words)];
+        while (*word != 0 && data.size() < length)
+            data.push_back(*word++);
+        if (data.size() < length)
+            data.push_back((state >> 8) % 11 == 0 ? '\n' : ' ');
+    }
+    return data;
+}
+
+// Data nothing can be taken out of, where compression only costs time
+static vector<char> randomData(size_t size)
+{
+    vector<char> data(size);
+    uint64_t state = 88172645463325252ull;
+    for (char& c : data)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        c = static_cast<char>(state >> 24);
+    }
+    return data;
+}
+
+// Runs one shell command with its output thrown away
+static void runCommand(CommandProcessor& processor, const string& command)
+{
+    ostringstream discard;
+    streambuf* saved = cout.rdbuf(discard.rdbuf());
+    bool running = true;
+    processor.processCommand(command, running);
+    cout.rdbuf(saved);
+}
+
+void Bench::compression(int clusterSize, int clusterCount)
+{
+    const size_t FILE_SIZE = size_t(8) << 20;
+    const double megabytes = static_cast<double>(FILE_SIZE) / (1024.0 * 1024.0);
+
+    cout << "Compression: import and export of an " << FILE_SIZE / (1024 * 1024) << " MiB file on a freshly formatted image ("
+        << clusterSize << "-byte clusters)\n";
+    cout << setw(12) << "image" << setw(8) << "data" << setw(14) << "on disk MiB" << setw(10) << "ratio"
+        << setw(16) << "import MB/s" << setw(16) << "export MB/s" << "\n";
+
+    for (const char* kind : { "text", "random" })
+    {
+        vector<char> data = string(kind) == "text" ? textData(FILE_SIZE) : randomData(FILE_SIZE);
+        {
+            ofstream source(SOURCE_PATH, ios::binary | ios::trunc);
+            source.write(data.data(), static_cast<streamsize>(data.size()));
+        }
+
+        for (bool compressed : { false, true })
+        {
+            remove(DISK_PATH);
+            remove(EXPORT_PATH);
+            Mini_FAT::initialize_Or_Open_FileSystem(DISK_PATH, Virtual_Disk::Mode::Mapped, clusterSize, clusterCount,
+                compressed ? Mini_FAT::FEATURE_COMPRESSION : 0);
+            Dedup_Table::load();
+            Directory* current = Mounted_Tree::mount();
+            CommandProcessor processor(&current);
+            long long freeBefore = static_cast<long long>(Mini_FAT::getAvailableClusters()) * clusterSize;
+
+            auto start = chrono::steady_clock::now();
+            runCommand(processor, string("import ") + SOURCE_PATH);
+            double importSeconds = secondsSince(start);
+            long long used = freeBefore - static_cast<long long>(Mini_FAT::getAvailableClusters()) * clusterSize;
+
+            start = chrono::steady_clock::now();
+            runCommand(processor, string("export ") + SOURCE_PATH + " " + EXPORT_PATH);
+            double exportSeconds = secondsSince(start);
+
+            Mounted_Tree::unmount();
+            Mini_FAT::CloseTheSystem();
+
+            ifstream exported(EXPORT_PATH, ios::binary);
+            vector<char> back((istreambuf_iterator<char>(exported)), istreambuf_iterator<char>());
+            cout << fixed << setprecision(2) << setw(12) << (compressed ? "compressed" : "plain") << setw(8) << kind
+                << setw(14) << static_cast<double>(used) / (1024.0 * 1024.0)
+                << setw(10) << (used > 0 ? static_cast<double>(FILE_SIZE) / static_cast<double>(used) : 0.0)
+                << setw(16) << megabytes / importSeconds << setw(16) << megabytes / exportSeconds << "\n";
+            if (back != data)
+                cout << "Error: The exported file does not match the imported one.\n";
+        }
+    }
+    cout << defaultfloat;
+    remove(DISK_PATH);
+    remove(SOURCE_PATH);
+    remove(EXPORT_PATH);
+}
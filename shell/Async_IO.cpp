@@ -0,0 +1,430 @@
+#include "Async_IO.h"
+#ifndef _WIN32
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/uio.h>
+#include <unistd.h>
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define ASYNC_IO_RING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+using namespace std;
+
+// One request slot: the iovecs must outlive the submission, so they live here rather than on the caller's stack
+struct Request
+{
+    bool busy = false;
+    bool isRead = false;
+    long long offset = 0;
+    size_t total = 0;
+    int count = 0;
+    iovec vectors[Async_IO::MAX_BUFFERS];
+    Async_IO::Completion done;
+};
+
+static Request requests[Async_IO::QUEUE_DEPTH];
+static unsigned inFlight = 0;
+static int fileFd = -1;
+
+// Moves the iovec window past 'done' bytes; returns false once every buffer is filled
+static bool advance(iovec*& next, int& count, size_t done)
+{
+    while (count > 0 && done >= next->iov_len)
+    {
+        done -= next->iov_len;
+        next++;
+        count--;
+    }
+    if (count > 0)
+    {
+        next->iov_base = static_cast<char*>(next->iov_base) + done;
+        next->iov_len -= done;
+    }
+    return count > 0;
+}
+
+// Finishes a request with blocking preadv/pwritev, resuming after 'already' bytes; reads past the end of the file are zeroed
+static long long transferNow(Request& request, size_t already)
+{
+    iovec* next = request.vectors;
+    int count = request.count;
+    long long offset = request.offset + static_cast<long long>(already);
+    if (!advance(next, count, already))
+        return static_cast<long long>(request.total);
+
+    while (count > 0)
+    {
+        ssize_t done = request.isRead
+            ? preadv(fileFd, next, count, static_cast<off_t>(offset))
+            : pwritev(fileFd, next, count, static_cast<off_t>(offset));
+        if (done < 0 && errno == EINTR)
+            continue;
+        if (done < 0)
+            return -errno;
+        if (done == 0)
+        {
+            if (!request.isRead)
+                return -EIO;
+            break;
+        }
+        offset += done;
+        advance(next, count, static_cast<size_t>(done));
+    }
+    for (; count > 0; next++, count--)
+        memset(next->iov_base, 0, next->iov_len);
+    return static_cast<long long>(request.total);
+}
+
+#ifdef ASYNC_IO_RING
+// The shared submission and completion rings, mapped from the io_uring file descriptor
+struct Ring
+{
+    int fd = -1;
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    void* sqRing = nullptr;
+    size_t sqRingSize = 0;
+    void* cqRing = nullptr;
+    size_t cqRingSize = 0;
+    size_t sqesSize = 0;
+};
+
+static Ring ring;
+
+// Entries written to the submission ring but not yet handed to the kernel
+static unsigned unsubmitted = 0;
+
+// Set once io_uring_enter fails for good: what was queued has been finished synchronously and the ring takes no more
+static bool ringBroken = false;
+
+static bool ringReady()
+{
+    return ring.fd >= 0 && !ringBroken;
+}
+
+static bool setUpRing()
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int ringFd = static_cast<int>(syscall(__NR_io_uring_setup, Async_IO::QUEUE_DEPTH, &params));
+    if (ringFd < 0)
+        return false;
+
+    ring.fd = ringFd;
+    ring.sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring.cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single)
+        ring.sqRingSize = ring.cqRingSize = max(ring.sqRingSize, ring.cqRingSize);
+
+    void* sq = mmap(nullptr, ring.sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    void* cq = single ? sq : mmap(nullptr, ring.cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    ring.sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, ring.sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED)
+    {
+        if (sqes != MAP_FAILED)
+            munmap(sqes, ring.sqesSize);
+        if (cq != MAP_FAILED && cq != sq)
+            munmap(cq, ring.cqRingSize);
+        if (sq != MAP_FAILED)
+            munmap(sq, ring.sqRingSize);
+        close(ringFd);
+        ring = Ring();
+        return false;
+    }
+
+    char* sqBase = static_cast<char*>(sq);
+    char* cqBase = static_cast<char*>(cq);
+    ring.sqRing = sq;
+    ring.cqRing = cq;
+    ring.sqHead = reinterpret_cast<unsigned*>(sqBase + params.sq_off.head);
+    ring.sqTail = reinterpret_cast<unsigned*>(sqBase + params.sq_off.tail);
+    ring.sqMask = reinterpret_cast<unsigned*>(sqBase + params.sq_off.ring_mask);
+    ring.sqArray = reinterpret_cast<unsigned*>(sqBase + params.sq_off.array);
+    ring.sqes = static_cast<io_uring_sqe*>(sqes);
+    ring.cqHead = reinterpret_cast<unsigned*>(cqBase + params.cq_off.head);
+    ring.cqTail = reinterpret_cast<unsigned*>(cqBase + params.cq_off.tail);
+    ring.cqMask = reinterpret_cast<unsigned*>(cqBase + params.cq_off.ring_mask);
+    ring.cqes = reinterpret_cast<io_uring_cqe*>(cqBase + params.cq_off.cqes);
+    return true;
+}
+
+static void tearDownRing()
+{
+    if (ring.fd < 0)
+        return;
+    munmap(ring.sqes, ring.sqesSize);
+    if (ring.cqRing != ring.sqRing)
+        munmap(ring.cqRing, ring.cqRingSize);
+    munmap(ring.sqRing, ring.sqRingSize);
+    close(ring.fd);
+    ring = Ring();
+    unsubmitted = 0;
+    ringBroken = false;
+}
+
+static int reapRing();
+
+// Gives up on a ring the kernel no longer accepts entries on: completions already posted are taken, and every
+// request still in flight is redone with preadv/pwritev (a read or write the kernel may yet finish moves the same
+// bytes). Later requests run synchronously
+static void abandonRing()
+{
+    ringBroken = true;
+    reapRing();
+    Async_IO::Completion callbacks[Async_IO::QUEUE_DEPTH];
+    long long results[Async_IO::QUEUE_DEPTH];
+    for (unsigned slot = 0; slot < Async_IO::QUEUE_DEPTH; slot++)
+    {
+        Request& request = requests[slot];
+        if (!request.busy)
+            continue;
+        results[slot] = transferNow(request, 0);
+        callbacks[slot] = move(request.done);
+        request.busy = false;
+        inFlight--;
+    }
+    unsubmitted = 0;
+    for (unsigned slot = 0; slot < Async_IO::QUEUE_DEPTH; slot++)
+    {
+        if (callbacks[slot])
+            callbacks[slot](results[slot]);
+    }
+}
+
+// Hands pending entries to the kernel and, when 'waitFor' is set, sleeps until at least that many completions are
+// posted. Returns false when the ring failed and was abandoned, its requests having run synchronously
+static bool enterRing(unsigned waitFor)
+{
+    while (true)
+    {
+        unsigned flags = waitFor > 0 ? IORING_ENTER_GETEVENTS : 0;
+        long entered = syscall(__NR_io_uring_enter, ring.fd, unsubmitted, waitFor, flags, nullptr, 0);
+        if (entered < 0 && errno == EINTR)
+            continue;
+        if (entered >= 0)
+        {
+            unsubmitted -= min(unsubmitted, static_cast<unsigned>(entered));
+            return true;
+        }
+        // The kernel is short of resources for now: the caller reaps and comes back
+        if (errno == EAGAIN || errno == EBUSY)
+            return true;
+        abandonRing();
+        return false;
+    }
+}
+
+// Pops every posted completion, then runs the callbacks once the ring and the slots are consistent again
+static int reapRing()
+{
+    unsigned ready[Async_IO::QUEUE_DEPTH];
+    long long results[Async_IO::QUEUE_DEPTH];
+    int reaped = 0;
+
+    unsigned head = *ring.cqHead;
+    while (head != __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE) && reaped < static_cast<int>(Async_IO::QUEUE_DEPTH))
+    {
+        const io_uring_cqe& cqe = ring.cqes[head & *ring.cqMask];
+        ready[reaped] = static_cast<unsigned>(cqe.user_data);
+        results[reaped] = cqe.res;
+        reaped++;
+        head++;
+    }
+    __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+
+    // Every reaped slot is free before any callback runs, so a callback may submit follow-up requests even when
+    // the queue was full
+    Async_IO::Completion callbacks[Async_IO::QUEUE_DEPTH];
+    for (int i = 0; i < reaped; i++)
+    {
+        Request& request = requests[ready[i]];
+
+        // A short transfer (end of file, or a partial write) is finished synchronously from where it stopped, and a
+        // failed one is retried that way from the start; the callback sees the error only if that fails too
+        if (results[i] >= 0 && static_cast<size_t>(results[i]) < request.total)
+            results[i] = transferNow(request, static_cast<size_t>(results[i]));
+        else if (results[i] < 0)
+            results[i] = transferNow(request, 0);
+
+        callbacks[i] = move(request.done);
+        request.busy = false;
+        inFlight--;
+    }
+    for (int i = 0; i < reaped; i++)
+    {
+        if (callbacks[i])
+            callbacks[i](results[i]);
+    }
+    return reaped;
+}
+
+static void queueOnRing(unsigned slot)
+{
+    const Request& request = requests[slot];
+    unsigned tail = *ring.sqTail;
+    unsigned index = tail & *ring.sqMask;
+
+    io_uring_sqe& sqe = ring.sqes[index];
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = request.isRead ? IORING_OP_READV : IORING_OP_WRITEV;
+    sqe.fd = fileFd;
+    sqe.off = static_cast<unsigned long long>(request.offset);
+    sqe.addr = reinterpret_cast<unsigned long long>(request.vectors);
+    sqe.len = static_cast<unsigned>(request.count);
+    sqe.user_data = slot;
+
+    ring.sqArray[index] = index;
+    __atomic_store_n(ring.sqTail, tail + 1, __ATOMIC_RELEASE);
+    unsubmitted++;
+}
+#endif
+
+// Finds a free slot, waiting for a completion first when the queue is full
+static unsigned claimSlot()
+{
+#ifdef ASYNC_IO_RING
+    while (ringReady() && inFlight == Async_IO::QUEUE_DEPTH)
+    {
+        if (enterRing(1))
+            reapRing();
+    }
+#endif
+    for (unsigned slot = 0; slot < Async_IO::QUEUE_DEPTH; slot++)
+    {
+        if (!requests[slot].busy)
+            return slot;
+    }
+    return 0;
+}
+
+template <typename T>
+static void submit(bool isRead, long long offset, span<const span<T>> buffers, Async_IO::Completion done)
+{
+    unsigned slot = claimSlot();
+    Request& request = requests[slot];
+    request.busy = true;
+    request.isRead = isRead;
+    request.offset = offset;
+    request.total = 0;
+    request.count = static_cast<int>(min(buffers.size(), Async_IO::MAX_BUFFERS));
+    for (int i = 0; i < request.count; i++)
+    {
+        request.vectors[i].iov_base = const_cast<char*>(buffers[i].data());
+        request.vectors[i].iov_len = buffers[i].size();
+        request.total += buffers[i].size();
+    }
+    request.done = move(done);
+    inFlight++;
+
+#ifdef ASYNC_IO_RING
+    if (ringReady())
+    {
+        queueOnRing(slot);
+        return;
+    }
+#endif
+
+    // No ring: the request completes before submit returns
+    long long result = transferNow(request, 0);
+    Async_IO::Completion callback = move(request.done);
+    request.busy = false;
+    inFlight--;
+    if (callback)
+        callback(result);
+}
+
+void Async_IO::start(int fd)
+{
+    fileFd = fd;
+#ifdef ASYNC_IO_RING
+    // Kernels without io_uring, or sandboxes that forbid it, leave the engine synchronous
+    if (ring.fd < 0)
+        setUpRing();
+#endif
+}
+
+void Async_IO::stop()
+{
+    drain();
+#ifdef ASYNC_IO_RING
+    tearDownRing();
+#endif
+    fileFd = -1;
+}
+
+bool Async_IO::usingRing()
+{
+#ifdef ASYNC_IO_RING
+    return ringReady();
+#else
+    return false;
+#endif
+}
+
+void Async_IO::submitRead(long long offset, span<const span<char>> buffers, Completion done)
+{
+    submit(true, offset, buffers, move(done));
+}
+
+void Async_IO::submitWrite(long long offset, span<const span<const char>> buffers, Completion done)
+{
+    submit(false, offset, buffers, move(done));
+}
+
+int Async_IO::poll()
+{
+#ifdef ASYNC_IO_RING
+    if (ringReady())
+    {
+        if (unsubmitted > 0 && !enterRing(0))
+            return 0;
+        return reapRing();
+    }
+#endif
+    return 0;
+}
+
+void Async_IO::drain()
+{
+#ifdef ASYNC_IO_RING
+    // Callbacks may submit follow-up requests, so keep going until nothing is left
+    while (ringReady() && inFlight > 0)
+    {
+        if (reapRing() == 0)
+            enterRing(1);
+    }
+#endif
+}
+
+bool Async_IO::waitForAny()
+{
+#ifdef ASYNC_IO_RING
+    while (ringReady() && inFlight > 0)
+    {
+        if (reapRing() > 0)
+            return true;
+        // An abandoned ring has run every request it held
+        if (!enterRing(1))
+            return true;
+    }
+#endif
+    return false;
+}
+
+unsigned Async_IO::getInFlight()
+{
+    return inFlight;
+}
+#endif
@@ -0,0 +1,49 @@
+#pragma once
+#include <functional>
+#include <span>
+using namespace std;
+
+/** Asynchronous positional I/O on the image file. Requests go through io_uring (raw syscalls) where the kernel
+    offers it; otherwise each request runs synchronously with preadv/pwritev and completes on submission.
+    A request the ring fails or cuts short is finished with preadv/pwritev before its callback runs, and a ring the
+    kernel stops accepting entries on is given up: what it held runs synchronously, and so does everything after. */
+class Async_IO
+{
+public:
+    /** Most requests in flight at once; submitting beyond it first waits for a completion. */
+    static constexpr unsigned QUEUE_DEPTH = 32;
+
+    /** Most buffers a single request may carry. */
+    static constexpr size_t MAX_BUFFERS = 64;
+
+    /** Called once a request has finished, with the number of bytes moved or a negative errno. */
+    using Completion = function<void(long long result)>;
+
+    /** Attaches the engine to an open file descriptor, setting up a ring when possible. */
+    static void start(int fd);
+
+    /** Waits for outstanding requests and tears the ring down. */
+    static void stop();
+
+    /** True when requests really run asynchronously through io_uring. */
+    static bool usingRing();
+
+    /** Queues a read of consecutive bytes starting at 'offset' into 'buffers'. Bytes past the end of the file read as zeros.
+        The buffers must stay alive until 'done' runs; the span array itself may be temporary. */
+    static void submitRead(long long offset, span<const span<char>> buffers, Completion done);
+
+    /** Queues a write of 'buffers' to consecutive bytes starting at 'offset'. Same lifetime rules as submitRead. */
+    static void submitWrite(long long offset, span<const span<const char>> buffers, Completion done);
+
+    /** Runs the callbacks of requests that have already completed, without blocking; returns how many ran. */
+    static int poll();
+
+    /** Blocks until every submitted request has completed and its callback has run. */
+    static void drain();
+
+    /** Blocks until at least one request has completed and its callback has run; false when none is in flight. */
+    static bool waitForAny();
+
+    /** Requests submitted whose callbacks have not run yet. */
+    static unsigned getInFlight();
+};
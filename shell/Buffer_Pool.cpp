@@ -0,0 +1,94 @@
+#include "Buffer_Pool.h"
+#include <algorithm>
+#include <new>
+using namespace std;
+
+vector<char*> Buffer_Pool::freeBuffers;
+vector<char*> Buffer_Pool::liveBuffers;
+vector<char*> Buffer_Pool::staleBuffers;
+size_t Buffer_Pool::allocated = 0;
+size_t Buffer_Pool::bufferSize = Buffer_Pool::DEFAULT_BUFFER_SIZE;
+
+char* Buffer_Pool::acquire()
+{
+    if (!freeBuffers.empty())
+    {
+        char* buffer = freeBuffers.back();
+        freeBuffers.pop_back();
+        return buffer;
+    }
+    allocated++;
+    char* buffer = static_cast<char*>(::operator new(bufferSize, align_val_t(ALIGNMENT)));
+    liveBuffers.push_back(buffer);
+    return buffer;
+}
+
+void Buffer_Pool::release(char* buffer)
+{
+    // A buffer lent out before the last clear is freed rather than pooled; it may be of an older size
+    if (!staleBuffers.empty())
+    {
+        auto stale = find(staleBuffers.begin(), staleBuffers.end(), buffer);
+        if (stale != staleBuffers.end())
+        {
+            staleBuffers.erase(stale);
+            freeBuffer(buffer);
+            return;
+        }
+    }
+    // Buffers stay pooled until the disk is closed: the pool only grows to the peak number in use at once
+    freeBuffers.push_back(buffer);
+}
+
+void Buffer_Pool::clear()
+{
+    for (char* buffer : freeBuffers)
+        freeBuffer(buffer);
+    freeBuffers.clear();
+    // What is left is in use; it is freed as it comes back
+    staleBuffers = liveBuffers;
+}
+
+void Buffer_Pool::freeBuffer(char* buffer)
+{
+    liveBuffers.erase(find(liveBuffers.begin(), liveBuffers.end(), buffer));
+    ::operator delete(buffer, align_val_t(ALIGNMENT));
+}
+
+size_t Buffer_Pool::getBufferSize()
+{
+    return bufferSize;
+}
+
+void Buffer_Pool::setBufferSize(size_t size)
+{
+    if (size == bufferSize)
+        return;
+    clear();
+    bufferSize = size;
+}
+
+size_t Buffer_Pool::getAllocated()
+{
+    return allocated;
+}
+
+Cluster_Buffer::Cluster_Buffer()
+    : buffer(Buffer_Pool::acquire())
+{
+}
+
+Cluster_Buffer::~Cluster_Buffer()
+{
+    Buffer_Pool::release(buffer);
+}
+
+char* Cluster_Buffer::data()
+{
+    return buffer;
+}
+
+span<char> Cluster_Buffer::bytes()
+{
+    return span<char>(buffer, Buffer_Pool::getBufferSize());
+}
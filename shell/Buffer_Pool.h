@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <span>
+#include <vector>
+using namespace std;
+
+/** Reusable pool of aligned cluster buffers, so cluster I/O does not allocate once the pool is warm. */
+class Buffer_Pool
+{
+public:
+    /** Buffers are sector aligned so they can be handed to the OS as they are. */
+    static const size_t ALIGNMENT = 512;
+
+    /** Size of every buffer in the pool until told otherwise (one cluster of a legacy volume). */
+    static const size_t DEFAULT_BUFFER_SIZE = 1024;
+
+    /** Size of every buffer in the pool (one cluster). */
+    static size_t getBufferSize();
+
+    /** Changes the buffer size, freeing the pooled buffers of the old size (see clear() for those still in use). */
+    static void setBufferSize(size_t size);
+
+    /** Takes a buffer from the pool, allocating a new one only when the pool is empty. */
+    static char* acquire();
+
+    /** Returns a buffer obtained from acquire() to the pool. */
+    static void release(char* buffer);
+
+    /** Frees every pooled buffer (used when the disk is closed). Buffers in use at the time are freed when they are
+        released instead of going back to the pool, so none outlives the clear or a size change after it. */
+    static void clear();
+
+    /** Number of buffers allocated since start-up (pooled or in use). */
+    static size_t getAllocated();
+
+private:
+    static vector<char*> freeBuffers;
+
+    /** Every buffer allocated and not yet freed, and those of them that were in use at the last clear(). */
+    static vector<char*> liveBuffers;
+    static vector<char*> staleBuffers;
+
+    static void freeBuffer(char* buffer);
+
+    static size_t allocated;
+    static size_t bufferSize;
+};
+
+/** A pooled cluster buffer that goes back to the pool when it leaves scope. */
+class Cluster_Buffer
+{
+public:
+    Cluster_Buffer();
+    ~Cluster_Buffer();
+    Cluster_Buffer(const Cluster_Buffer&) = delete;
+    Cluster_Buffer& operator=(const Cluster_Buffer&) = delete;
+
+    char* data();
+    span<char> bytes();
+
+private:
+    char* buffer;
+};
@@ -0,0 +1,170 @@
+#include "Cluster_Cache.h"
+#include "Virtual_Disk.h"
+#include "Buffer_Pool.h"
+#include <algorithm>
+#include <cstring>
+using namespace std;
+
+// A flush never has more adjacent dirty clusters than one backend run can carry
+static_assert(Cluster_Cache::CAPACITY <= static_cast<int>(Virtual_Disk::RUN_LIMIT), "cache larger than a run");
+
+vector<Cluster_Cache::Slot> Cluster_Cache::slots;
+int Cluster_Cache::hand = 0;
+long long Cluster_Cache::hits = 0;
+long long Cluster_Cache::misses = 0;
+long long Cluster_Cache::writebacks = 0;
+
+void Cluster_Cache::read(char* out, int clusterIndex)
+{
+    int slot = lookup(clusterIndex);
+    if (slot == -1)
+    {
+        slot = claim(clusterIndex);
+        Virtual_Disk::readFromImage(slots[slot].data, clusterIndex);
+    }
+    memcpy(out, slots[slot].data, Virtual_Disk::getClusterSize());
+}
+
+void Cluster_Cache::write(const char* data, int clusterIndex)
+{
+    // A write always covers the whole cluster, so a miss does not need to read the old contents
+    int slot = lookup(clusterIndex);
+    if (slot == -1)
+        slot = claim(clusterIndex);
+    memcpy(slots[slot].data, data, Virtual_Disk::getClusterSize());
+    slots[slot].dirty = true;
+}
+
+bool Cluster_Cache::peek(int clusterIndex, span<char> out)
+{
+    int slot = find(clusterIndex);
+    if (slot == -1)
+        return false;
+    memcpy(out.data(), slots[slot].data, min(out.size(), Virtual_Disk::getClusterSize()));
+    return true;
+}
+
+void Cluster_Cache::refresh(int clusterIndex, const char* data)
+{
+    int slot = find(clusterIndex);
+    if (slot == -1)
+        return;
+    memcpy(slots[slot].data, data, Virtual_Disk::getClusterSize());
+    slots[slot].dirty = false;
+}
+
+void Cluster_Cache::flush()
+{
+    // Write back in offset order so the image is visited front to back
+    Slot* dirty[CAPACITY];
+    size_t count = 0;
+    for (auto& slot : slots)
+    {
+        if (slot.dirty)
+            dirty[count++] = &slot;
+    }
+    sort(dirty, dirty + count, [](const Slot* a, const Slot* b) {
+        return a->clusterIndex < b->clusterIndex;
+        });
+
+    // Adjacent dirty clusters leave as a single run
+    size_t first = 0;
+    while (first < count)
+    {
+        size_t length = 1;
+        while (first + length < count && dirty[first + length]->clusterIndex == dirty[first]->clusterIndex + static_cast<int>(length))
+            length++;
+
+        span<const char> buffers[CAPACITY];
+        for (size_t i = 0; i < length; i++)
+        {
+            buffers[i] = span<const char>(dirty[first + i]->data, Virtual_Disk::getClusterSize());
+            dirty[first + i]->dirty = false;
+        }
+        Virtual_Disk::writeRunToImage(dirty[first]->clusterIndex, span<const span<const char>>(buffers, length));
+        writebacks += static_cast<long long>(length);
+        first += length;
+    }
+}
+
+void Cluster_Cache::clear()
+{
+    flush();
+    for (auto& slot : slots)
+        Buffer_Pool::release(slot.data);
+    slots.clear();
+    hand = 0;
+}
+
+long long Cluster_Cache::getHits()
+{
+    return hits;
+}
+
+long long Cluster_Cache::getMisses()
+{
+    return misses;
+}
+
+long long Cluster_Cache::getWritebacks()
+{
+    return writebacks;
+}
+
+int Cluster_Cache::lookup(int clusterIndex)
+{
+    int slot = find(clusterIndex);
+    if (slot == -1)
+    {
+        misses++;
+        return -1;
+    }
+    hits++;
+    slots[slot].referenced = true;
+    return slot;
+}
+
+int Cluster_Cache::find(int clusterIndex)
+{
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+        if (slots[i].clusterIndex == clusterIndex)
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+int Cluster_Cache::claim(int clusterIndex)
+{
+    // Slots take their buffers from the pool once, on first use, and recycle them from then on
+    if (slots.empty())
+    {
+        slots.resize(CAPACITY);
+        for (auto& slot : slots)
+            slot.data = Buffer_Pool::acquire();
+    }
+
+    // Sweep the clock: referenced slots get a second chance, the first unreferenced one is the victim
+    while (slots[hand].referenced)
+    {
+        slots[hand].referenced = false;
+        hand = (hand + 1) % CAPACITY;
+    }
+    int victim = hand;
+    hand = (hand + 1) % CAPACITY;
+
+    Slot& slot = slots[victim];
+    if (slot.clusterIndex != -1 && slot.dirty)
+        writeBack(slot);
+    slot.clusterIndex = clusterIndex;
+    slot.dirty = false;
+    slot.referenced = true;
+    return victim;
+}
+
+void Cluster_Cache::writeBack(Slot& slot)
+{
+    Virtual_Disk::writeToImage(slot.data, slot.clusterIndex);
+    slot.dirty = false;
+    writebacks++;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <span>
+#include <vector>
+using namespace std;
+
+/** Fixed-size write-back cache of clusters sitting between Virtual_Disk's public API and its backends. */
+class Cluster_Cache
+{
+public:
+    /** Number of clusters the cache can hold. */
+    static const int CAPACITY = 64;
+
+    /** Multi-cluster transfers up to this size go through the cache; larger (bulk file data) bypass it. */
+    static const size_t ADMIT_LIMIT = 8;
+
+    /** Copies a cluster into 'out', loading it from the image on a miss. */
+    static void read(char* out, int clusterIndex);
+
+    /** Stores a cluster in the cache and marks it dirty; the image is only written on eviction or flush. */
+    static void write(const char* data, int clusterIndex);
+
+    /** Copies the cached copy of a cluster into 'out' if one is resident; no miss is recorded and nothing is loaded. */
+    static bool peek(int clusterIndex, span<char> out);
+
+    /** Replaces a resident copy after a write that bypassed the cache; the copy becomes clean. */
+    static void refresh(int clusterIndex, const char* data);
+
+    /** Writes every dirty cluster back to the image in ascending offset order, adjacent clusters as one run. */
+    static void flush();
+
+    /** Flushes and then forgets every cached cluster (used when the disk is closed). */
+    static void clear();
+
+    /** Lookups served from the cache, lookups that went to the image, and clusters written back. */
+    static long long getHits();
+    static long long getMisses();
+    static long long getWritebacks();
+
+private:
+    /** One cached cluster; 'referenced' is the CLOCK second-chance bit. */
+    struct Slot
+    {
+        int clusterIndex = -1;
+        bool dirty = false;
+        bool referenced = false;
+        char* data = nullptr;
+    };
+
+    /** The cache is small enough that a scan of the slots beats hashing and never allocates. */
+    static vector<Slot> slots;
+
+    /** Position of the CLOCK hand. */
+    static int hand;
+
+    static long long hits;
+    static long long misses;
+    static long long writebacks;
+
+    /** Returns the slot holding 'clusterIndex', or -1, and records a hit or miss. */
+    static int lookup(int clusterIndex);
+
+    /** Returns the slot holding 'clusterIndex', or -1, without touching counters or the CLOCK bit. */
+    static int find(int clusterIndex);
+
+    /** Picks a slot for 'clusterIndex' with the CLOCK policy, writing the victim back if it is dirty. */
+    static int claim(int clusterIndex);
+
+    /** Writes one dirty slot to the image. */
+    static void writeBack(Slot& slot);
+};
@@ -1,8 +1,13 @@
 #include "CommandProcessor.h"
 #include "File_Entry.h"
+#include "File_Handle.h"
 #include "Directory.h"
 #include"Mini_FAT.h"
+#include "Cluster_Cache.h"
+#include "Dedup_Table.h"
 #include "Parser.h"
+#include "Mounted_Tree.h"
+#include "Path_Resolver.h"
 #include <algorithm>
 #include <cstring>
 #include <cctype>
@@ -111,29 +116,64 @@ CommandProcessor::CommandProcessor(Directory** currentDirPtr)
     commandHelp["write"] = {
         "Writes content to an existing file.",
         "Usage:\n"
-        "  write [file_path]\n\n"
+        "  write [file_path]\n"
+        "  write -a [file_path]\n"
+        "  write -o [offset] [file_path]\n\n"
         "Syntax:\n"
         "  - Write to a file: `write [file_name]`\n"
-        "  - Write to a file in a specific path: `write [path/to/file]`\n\n"
+        "  - Write to a file in a specific path: `write [path/to/file]`\n"
+        "  - Append to the end of a file: `write -a [file_name]`\n"
+        "  - Overwrite bytes starting at an offset: `write -o [offset] [file_name]`\n\n"
         "Description:\n"
         "  - Opens the specified file for writing.\n"
-        "  - Allows input of multiple lines of text until a specific termination input is given."
+        "  - Allows input of multiple lines of text until a specific termination input is given.\n"
+        "  - With -a the text is added after the existing content instead of replacing it; only the last cluster\n"
+        "    of the file and any new ones are written.\n"
+        "  - With -o the text replaces the bytes from that offset on (growing the file if it runs past the end);\n"
+        "    the rest of the file is left as it is."
     };
 
     // Add the "type" command details to the commandHelp map
     commandHelp["type"] = {
         "Displays the content of a file.",
         "Usage:\n"
-        "  type [file_path]\n\n"
+        "  type [-o offset] [-n length] [file_path]+\n\n"
         "Syntax:\n"
         "  - Display file content: `type [file_name]`\n"
-        "  - Display content of a file in a specific path: `type [path/to/file]`\n\n"
+        "  - Display content of a file in a specific path: `type [path/to/file]`\n"
+        "  - Display a byte range: `type -o [offset] -n [length] [file_name]`\n\n"
         "Description:\n"
         "  - Reads and displays the content of the specified file.\n"
+        "  - With -o the display starts at that byte; with -n it stops after that many bytes. Only the clusters\n"
+        "    holding the range are read.\n"
         "  - Displays an error if the file is not found or is a directory.\n"
         "  - Supports text-based files; non-readable formats may display as gibberish."
     };
 
+    // Add the "head" command details to the commandHelp map
+    commandHelp["head"] = {
+        "Displays the first lines of a file.",
+        "Usage:\n"
+        "  head [-n lines] [file_path]\n\n"
+        "Syntax:\n"
+        "  - Display the first 10 lines: `head [file_name]`\n"
+        "  - Display the first N lines: `head -n [N] [file_name]`\n\n"
+        "Description:\n"
+        "  - Reads the file from its start only as far as the lines shown."
+    };
+
+    // Add the "tail" command details to the commandHelp map
+    commandHelp["tail"] = {
+        "Displays the last lines of a file.",
+        "Usage:\n"
+        "  tail [-n lines] [file_path]\n\n"
+        "Syntax:\n"
+        "  - Display the last 10 lines: `tail [file_name]`\n"
+        "  - Display the last N lines: `tail -n [N] [file_name]`\n\n"
+        "Description:\n"
+        "  - Reads the file backwards from its end, one cluster at a time, only as far as the lines shown."
+    };
+
     // Add the "del" command details to the commandHelp map
     commandHelp["del"] = {
         "Deletes one or more files.",
@@ -255,6 +295,36 @@ CommandProcessor::CommandProcessor(Directory** currentDirPtr)
         "  - For a specific command, provides detailed information, including its usage and syntax."
     };
 
+    // Add the "stats" command details to the commandHelp map
+    commandHelp["stats"] = {
+        "Displays disk I/O counters.",
+        "Usage:\n"
+        "  stats\n\n"
+        "Syntax:\n"
+        "  - Show the counters: `stats`\n\n"
+        "Description:\n"
+        "  - Shows how many FAT clusters the previous command wrote, and the total since the disk was opened.\n"
+        "  - Shows the cluster cache hits, misses and write-backs.\n"
+        "  - Shows how many path steps were answered by the dentry cache and how many searched a directory.\n"
+        "  - Shows how many directories are loaded, the memory they take against the budget, and how many were evicted.\n"
+        "  - On a compressed volume, shows how many bytes of file data were compressed and the bytes they were stored in."
+    };
+
+    // Add the "dedupstats" command details to the commandHelp map
+    commandHelp["dedupstats"] = {
+        "Displays how much space deduplication saves.",
+        "Usage:\n"
+        "  dedupstats\n\n"
+        "Syntax:\n"
+        "  - Show the savings: `dedupstats`\n\n"
+        "Description:\n"
+        "  - Shows how many chains of file data are shared, and how many references files hold to them.\n"
+        "  - Shows the clusters and bytes the extra references would have taken as copies of their own.\n"
+        "  - Savings are counted in whole frames: a frame is shared only when all of its data matches another one,\n"
+        "    and on a compressed volume a frame is 16 clusters, so data repeated in smaller pieces saves nothing.\n"
+        "  - Deduplication is chosen when the disk is formatted; on other disks there is nothing to show."
+    };
+
     // Add the "quit" command details to the commandHelp map
     commandHelp["quit"] = {
         "Exits the application.",
@@ -363,20 +433,47 @@ void CommandProcessor::processCommand(const string& input, bool& isRunning)
         else
         {
             cout << "Error: Invalid syntax for type command.\n";
-            cout << "Usage: type [file_path]+ (one or more file paths)\n";
+            cout << "Usage: type [-o offset] [-n length] [file_path]+ (one or more file paths)\n";
+        }
+    }
+    else if (cmd.name == "head" || cmd.name == "tail")
+    {
+        // Display the first or last lines of a file
+        long long lines = 10;
+        if (cmd.arguments.size() == 1)
+        {
+            handleHeadTail(cmd.arguments[0], lines, cmd.name == "tail");
+        }
+        else if (cmd.arguments.size() == 3 && toLower(cmd.arguments[0]) == "-n" && parseNumber(cmd.arguments[1], lines))
+        {
+            handleHeadTail(cmd.arguments[2], lines, cmd.name == "tail");
+        }
+        else
+        {
+            cout << "Error: Invalid syntax for " << cmd.name << " command.\n";
+            cout << "Usage: " << cmd.name << " [-n lines] [file_path]\n";
         }
     }
     else if (cmd.name == "write")
     {
         // Write content to a file
+        long long offset = -1;
         if (cmd.arguments.size() == 1)
         {
-            handleWrite(cmd.arguments[0]);
+            handleWrite(cmd.arguments[0], false, -1);
+        }
+        else if (cmd.arguments.size() == 2 && toLower(cmd.arguments[0]) == "-a")
+        {
+            handleWrite(cmd.arguments[1], true, -1);
+        }
+        else if (cmd.arguments.size() == 3 && toLower(cmd.arguments[0]) == "-o" && parseNumber(cmd.arguments[1], offset))
+        {
+            handleWrite(cmd.arguments[2], false, offset);
         }
         else
         {
             cout << "Error: Invalid syntax for write command.\n";
-            cout << "Usage: write [file_path] or [file_name]\n";
+            cout << "Usage: write [-a | -o offset] [file_path] or [file_name]\n";
         }
     }
     else if (cmd.name == "echo")
@@ -512,6 +609,32 @@ void CommandProcessor::processCommand(const string& input, bool& isRunning)
             handleRd(cmd.arguments);
         }
     }
+    else if (cmd.name == "stats")
+    {
+        // Show disk I/O counters
+        if (cmd.arguments.empty())
+        {
+            handleStats();
+        }
+        else
+        {
+            cout << "Error: Invalid syntax for stats command.\n";
+            cout << "Usage: stats\n";
+        }
+    }
+    else if (cmd.name == "dedupstats")
+    {
+        // Show what identical data shares
+        if (cmd.arguments.empty())
+        {
+            handleDedupStats();
+        }
+        else
+        {
+            cout << "Error: Invalid syntax for dedupstats command.\n";
+            cout << "Usage: dedupstats\n";
+        }
+    }
     else if (cmd.name == "quit")
     {
         // Exit the application
@@ -530,6 +653,17 @@ void CommandProcessor::processCommand(const string& input, bool& isRunning)
         // Handle unknown commands
         cout << "Error: Unknown command '" << cmd.name << "'. Type 'help' to see available commands.\n";
     }
+
+    // Step 6: Write the directory clusters, deduplication records and FAT pages this command changed, then the
+    // clusters it left dirty in the cache
+    Directory::flushAll();
+    Mounted_Tree::endCommand(*currentDirectoryPtr);
+    Dedup_Table::sync();
+    long long fatWritesBefore = Mini_FAT::getFATClusterWrites();
+    Mini_FAT::writeFAT();
+    Virtual_Disk::sync(false);
+    if (cmd.name != "stats")
+        lastCommandFATWrites = Mini_FAT::getFATClusterWrites() - fatWritesBefore;
 }
 
 // Converts a given string to lowercase
@@ -655,53 +789,46 @@ void CommandProcessor::handleMd(const string& dirPath)
         return;
     }
 
-    // Step 6: Check if a directory with the same name already exists
-    for (const auto& entry : parentDir->DirOrFiles) {
-        if (!entry.getIsFile()) { // Ensure we only compare directories
-            string existingName = toLower(entry.getName());
-            string newName = toLower(dirName);
+    // Step 6: Check if a directory with the same name already exists (case-insensitive, through the name index)
+    if (parentDir->findEntry(dirName, true) != -1) {
+        cout << "Error: Directory '" << dirName << "' already exists.\n";
+        return;
+    }
 
-            if (existingName == newName) {
-                cout << "Error: Directory '" << dirName << "' already exists.\n";
-                return;
-            }
-        }
+    // Step 7: Clean the directory name without altering its case; a bad name is refused before any cluster is taken
+    string cleanedName = Directory_Entry::cleanTheName(dirName);
+    if (cleanedName.empty()) {
+        cout << "Error: Invalid directory name.\n";
+        return;
     }
 
-    // Step 7: Allocate a new cluster for the directory
+    // Step 8: Allocate a new cluster for the directory
     int newCluster = Mini_FAT::getAvailableCluster();
     if (newCluster == -1) {
         cout << "Error: No available clusters to create directory.\n";
         return;
     }
 
-    // Step 8: Initialize the new directory's FAT pointer
+    // Step 9: Initialize the new directory's FAT pointer
     Mini_FAT::setClusterPointer(newCluster, -1); // -1 indicates end of file
 
-    // Step 9: Clean the directory name without altering its case
-    string cleanedName = Directory_Entry::cleanTheName(dirName);
-    if (cleanedName.empty()) {
-        cout << "Error: Invalid directory name.\n";
-        return;
-    }
+    // A recycled cluster still holds whatever was freed there: clear it so the new directory reads back empty
+    Virtual_Disk::writeCluster(span<const char>(), newCluster);
 
     // Step 10: Create a new Directory object
-    Directory* newDir = new Directory(cleanedName, 0x10, newCluster, parentDir);
+    Directory* newDir = Mounted_Tree::createDirectory(cleanedName, 0x10, newCluster, parentDir);
     newDir->readDirectory(); // Initialize directory entries
 
     // Step 11: Create a Directory_Entry for the new directory
     Directory_Entry newDirEntry(cleanedName, 0x10, newCluster);
 
-    // Step 12: Assign the subDirectory pointer
-    newDirEntry.subDirectory = newDir;
+    // Step 12: Add the new directory entry to the parent directory and write it to the virtual disk
+    parentDir->addEntry(newDirEntry);
 
-    // Step 13: Add the new directory entry to the parent directory's DirOrFiles list
-    parentDir->DirOrFiles.push_back(newDirEntry);
+    // Step 13: Record the loaded directory in the parent's side table
+    parentDir->attachSubDirectory(newDir);
 
-    // Step 14: Write the updated parent directory to the virtual disk
-    parentDir->writeDirectory();
-
-    // Step 15: Confirm successful creation of the directory
+    // Step 14: Confirm successful creation of the directory
     cout << "Directory '" << cleanedName << "' created successfully.\n";
 }
 
@@ -754,15 +881,16 @@ void CommandProcessor::handleRd(const vector<string>& directories)
         }
 
         // Step 7: Check if the directory is empty
-        if (!dirEntry.subDirectory->isEmpty()) {
+        Directory* subDir = parentDir->openSubDirectory(dirIndex);
+        if (!subDir->isEmpty()) {
             cout << "Error: Directory '" << dirPath << "' is not empty.\n";
             continue;
         }
 
-        // Step 8: Proceed with deleting the directory
-        delete dirEntry.subDirectory; // Free memory associated with the subdirectory
-        parentDir->DirOrFiles.erase(parentDir->DirOrFiles.begin() + dirIndex); // Remove entry from parent directory
-        parentDir->writeDirectory(); // Save changes to the virtual disk
+        // Step 8: Proceed with deleting the directory and releasing the cluster md gave it
+        subDir->emptymyClusters();
+        Mounted_Tree::releaseDirectory(subDir); // Return the node to the mounted tree
+        parentDir->removeEntry(dirEntry); // Remove entry from parent directory and save it to the virtual disk
 
         cout << "Directory '" << dirPath << "' deleted successfully.\n";
     }
@@ -803,159 +931,29 @@ void CommandProcessor::handleCd(const string& path)
         return;
     }
 
-    // **Step 3: Determine if the Path is Absolute**
-    bool isAbsolute = false; // Flag to check if the path is absolute
-    Directory* traversalDir = *currentDirectoryPtr; // Start traversal from the current directory
-    string drive = ""; // Store the drive letter (e.g., "C:")
-    size_t startIndex = 0; // Index to start parsing the path
-
-    // **Step 4: Check if the Path Starts with a Drive Letter (e.g., "C:\")**
-    if (path.length() >= 3 && isalpha(path[0]) && path[1] == ':' && path[2] == '\\')
-    {
-        isAbsolute = true;
-        drive = toUpper(path.substr(0, 2)); // Extract the drive letter (e.g., "C:")
-
-        // Traverse to the root directory
-        while (traversalDir->parent != nullptr)
-        {
-            traversalDir = traversalDir->parent;
-        }
-
-        // Verify the drive matches the current drive
-        string traversalDrive = toUpper(traversalDir->name.substr(0, 2));
-        if (traversalDrive != drive)
-        {
-            cout << "Error: Drive '" << drive << "' not found.\n";
-            return;
-        }
-
-        // Update the path to remove the drive portion (e.g., "C:\" → "Users\John")
-        string updatedPath = path.substr(3);
-
-        // Split the updated path into components (e.g., "Users", "John")
-        vector<string> pathComponents;
-        stringstream ss(updatedPath); //to split the path by '\\'.
-        string component;
-        while (getline(ss, component, '\\'))
-        {
-            if (!component.empty())
-                pathComponents.push_back(component);
-        }
-
-        // **Step 5: Traverse the Absolute Path**
-        for (const auto& dirName : pathComponents)
-        {
-            if (dirName == ".")
-            {
-                // "." means no change; continue to the next component
-                continue;
-            }
-            else if (dirName == "..")
-            {
-                // ".." means move to the parent directory
-                if (traversalDir->parent != nullptr)
-                {
-                    traversalDir = traversalDir->parent;
-                }
-                else
-                {
-                    cout << "Error: Already at the root directory.\n";
-                    return;
-                }
-            }
-            else
-            {
-                // Search for the directory in the current directory
-                int dirIndex = traversalDir->searchDirectory(dirName);
-                if (dirIndex == -1)
-                {
-                    cout << "Error: System cannot find the specified folder '" << dirName << "'.\n";
-                    return;
-                }
-
-                // Check if the entry is a directory
-                Directory_Entry* subDirEntry = &traversalDir->DirOrFiles[dirIndex];
-                if (subDirEntry->dir_attr != 0x10) // 0x10 indicates a directory
-                {
-                    cout << "Error: '" << dirName << "' is not a directory.\n";
-                    return;
-                }
-
-                // Move to the subdirectory
-                traversalDir = subDirEntry->subDirectory;
-            }
-        }
-
-        // Update the current directory pointer
-        *currentDirectoryPtr = traversalDir;
-        cout << "Changed directory to: " << (*currentDirectoryPtr)->getFullPath() << "\n";
-        return;
-    }
-
-    // **Step 6: Handle Relative Paths**
-    // Split the relative path into components (e.g., "Documents\Projects")
-    vector<string> pathComponents;
-    stringstream ssNonAbsolute(path);
-    string component;
-    while (getline(ssNonAbsolute, component, '\\'))
+    // **Step 3: Resolve the path, absolute ("C:\...") or relative, through the shared resolver**
+    Path_Resolver::Result result = Path_Resolver::resolve(*currentDirectoryPtr, path);
+    switch (result.status)
     {
-        if (!component.empty())
-            pathComponents.push_back(component);
-    }
-
-    // Traverse the relative path
-    bool errorOccurred = false; // Flag to track errors during traversal
-    for (const auto& dirName : pathComponents)
-    {
-        if (dirName == ".")
-        {
-            // "." means no change; continue to the next component
-            continue;
-        }
-        else if (dirName == "..")
-        {
-            // ".." means move to the parent directory
-            if (traversalDir->parent != nullptr)
-            {
-                traversalDir = traversalDir->parent;
-            }
-            else
-            {
-                cout << "Error: Already at the root directory.\n";
-                errorOccurred = true;
-                break;
-            }
-        }
-        else
-        {
-            // Search for the directory in the current directory
-            int dirIndex = traversalDir->searchDirectory(dirName);
-            if (dirIndex == -1)
-            {
-                cout << "Error: System cannot find the specified folder '" << dirName << "'.\n";
-                errorOccurred = true;
-                break;
-            }
-
-            // Check if the entry is a directory
-            Directory_Entry* subDirEntry = &traversalDir->DirOrFiles[dirIndex];
-            if (subDirEntry->dir_attr != 0x10) // 0x10 indicates a directory
-            {
-                cout << "Error: '" << dirName << "' is not a directory.\n";
-                errorOccurred = true;
-                break;
-            }
-
-            // Move to the subdirectory
-            traversalDir = subDirEntry->subDirectory;
-        }
-    }
-
-    // **Step 7: Update Current Directory if No Errors Occurred**
-    if (!errorOccurred)
-    {
-        *currentDirectoryPtr = traversalDir;
+    case Path_Resolver::Status::Found:
+    case Path_Resolver::Status::Empty:
+        // **Step 4: Update the current directory pointer** (a path of separators only stays where it is)
+        if (result.directory != nullptr)
+            *currentDirectoryPtr = result.directory;
         cout << "Changed directory to: " << (*currentDirectoryPtr)->getFullPath() << "\n";
+        break;
+    case Path_Resolver::Status::NotFound:
+        cout << "Error: System cannot find the specified folder '" << result.component << "'.\n";
+        break;
+    case Path_Resolver::Status::NotADirectory:
+        cout << "Error: '" << result.component << "' is not a directory.\n";
+        break;
+    case Path_Resolver::Status::AboveRoot:
+        cout << "Error: Already at the root directory.\n";
+        break;
+    case Path_Resolver::Status::WrongDrive:
+        cout << "Error: Drive '" << result.component << "' not found.\n";
+        break;
     }
 }
 
@@ -992,6 +990,46 @@ void CommandProcessor::handleHistory()
 }
 
 // Handles the "quit" command to exit the shell
+// Displays the FAT write counters and the cluster cache statistics
+void CommandProcessor::handleStats()
+{
+    Virtual_Disk::Mode mode = Virtual_Disk::getMode();
+    cout << "Disk backend:                      "
+        << (mode == Virtual_Disk::Mode::Mapped ? "mapped" : mode == Virtual_Disk::Mode::Positional ? "positional" : "stream") << "\n";
+    cout << "FAT cluster writes (last command): " << lastCommandFATWrites << "\n";
+    cout << "FAT cluster writes (total):        " << Mini_FAT::getFATClusterWrites() << "\n";
+    cout << "Cache hits:                        " << Cluster_Cache::getHits() << "\n";
+    cout << "Cache misses:                      " << Cluster_Cache::getMisses() << "\n";
+    cout << "Cache write-backs:                 " << Cluster_Cache::getWritebacks() << "\n";
+    cout << "Path lookups cached:               " << Path_Resolver::getHits() << "\n";
+    cout << "Path lookups searched:             " << Path_Resolver::getMisses() << "\n";
+    cout << "Directories loaded:                " << Mounted_Tree::getLoadedDirectories() << "\n";
+    cout << "Directory tree memory:             " << Mounted_Tree::getMemoryUsage() << " of " << Mounted_Tree::getBudget() << " bytes\n";
+    cout << "Directories evicted:               " << Mounted_Tree::getEvictions() << "\n";
+    if (Mini_FAT::hasCompression())
+        cout << "Compressed frame bytes:            " << File_Handle::getFrameBytesIn() << " stored in " << File_Handle::getFrameBytesOut() << "\n";
+}
+
+// Handles the "dedupstats" command
+// Displays the shared chains, the references to them and the space the sharing saves
+void CommandProcessor::handleDedupStats()
+{
+    if (!Mini_FAT::hasDeduplication())
+    {
+        cout << "Deduplication is not enabled on this disk.\n";
+        return;
+    }
+    long long saved = Dedup_Table::getSavedClusters();
+    cout << "Chains tracked:                    " << Dedup_Table::getChains() << "\n";
+    cout << "References to them:                " << Dedup_Table::getReferences() << "\n";
+    cout << "Shared references:                 " << Dedup_Table::getReferences() - Dedup_Table::getChains() << "\n";
+    cout << "Clusters saved:                    " << saved << " (" << saved * Mini_FAT::getClusterSize() << " bytes)\n";
+    // Only whole identical frames are shared, so the savings say nothing about repeats smaller than a frame
+    long long frameSize = File_Handle::getFrameSize();
+    cout << "Savings counted in whole frames of " << frameSize / Mini_FAT::getClusterSize() << " cluster(s) ("
+        << frameSize << " bytes); smaller repeats are not shared.\n";
+}
+
 void CommandProcessor::handleQuit(bool& isRunning)
 {
     // Display a message indicating the shell is quitting
@@ -1066,7 +1104,7 @@ File_Entry* CommandProcessor::MoveToFile(string& path)
 
     // **Step 6: Create and Return a File_Entry Object**
     // Create a new File_Entry object for the file
-    File_Entry* file = new File_Entry(fileEntry, targetDir);
+    File_Entry* file = Mounted_Tree::createFile(fileEntry, targetDir);
 
     // **Load the File's Content**
     // Read the file's content into memory (if necessary)
@@ -1079,83 +1117,29 @@ File_Entry* CommandProcessor::MoveToFile(string& path)
 // Navigates to a directory based on the provided path and returns a Directory pointer
 Directory* CommandProcessor::MoveToDir(const string& path)
 {
-    // **Step 1: Normalize the Input Path**
-    // Create a local modifiable copy of the input path to work with
-    string normalizedPath = path;
-
-    // **Step 2: Split the Path into Components**
-    // Use a stringstream to split the path by the backslash ('\\') delimiter
-    vector<string> dirs; // Stores the individual directory components
-    stringstream ss(normalizedPath);//String stream (can read from and write to a string).
-    string token;
-    while (getline(ss, token, '\\'))
-    {
-        if (!token.empty()) {
-            dirs.push_back(token); // Add non-empty tokens (directory names) to the vector
-        }
-    }
-
-    // **Step 3: Validate the Path**
-    // Check if the path is empty after splitting
-    if (dirs.empty())
+    // The resolver walks the path through its dentry cache; only the messages are specific to this caller
+    Path_Resolver::Result result = Path_Resolver::resolve(*currentDirectoryPtr, path);
+    switch (result.status)
     {
+    case Path_Resolver::Status::Found:
+        return result.directory;
+    case Path_Resolver::Status::Empty:
         cout << "Error: Path is empty.\n";
-        return nullptr; // Return nullptr if the path is invalid
-    }
-
-    // **Step 4: Start at the Current Directory**
-    // Begin traversal from the current directory
-    Directory* current = *currentDirectoryPtr;
-
-    // **Step 5: Handle Root Navigation**
-    // Check if the path starts with the root drive (e.g., "C:")
-    string rootDrive = toUpper(current->getDrive()) + ":"; // Get the current drive (e.g., "C:")
-    if (toUpper(dirs[0]) == rootDrive)
-    {
-        // Navigate to the root directory by moving up the directory tree
-        while (current->parent != nullptr)
-        {
-            current = current->parent; // Move to the parent directory
-        }
-        dirs.erase(dirs.begin()); // Remove the root drive from the path components
-    }
-
-    // **Step 6: Traverse the Path Components**
-    // Iterate through each directory component in the path
-    for (const auto& dirName : dirs)
-    {
-        // **Search for the Directory in the Current Directory**
-        int dirIndex = current->searchDirectory(dirName); // Search for the directory by name
-        if (dirIndex == -1)
-        {
-            // **Error: Directory Not Found**
-            cout << "Error: Directory '" << dirName << "' not found in '" << current->getFullPath() << "'.\n";
-            return nullptr; // Return nullptr if the directory is not found
-        }
-
-        // **Retrieve the Directory Entry**
-        Directory_Entry& entry = current->DirOrFiles[dirIndex]; // Get the directory entry
-
-        // **Validate the Entry Type**
-        if (entry.dir_attr != 0x10) // Check if the entry is a directory (0x10 indicates a directory)
-        {
-            cout << "Error: '" << dirName << "' is not a directory.\n";
-            return nullptr; // Return nullptr if the entry is not a directory
-        }
-
-        // **Move to the Subdirectory**
-        current = entry.subDirectory; // Update the current directory to the subdirectory
-        if (!current)
-        {
-            // **Error: Subdirectory Not Accessible**
-            cout << "Error: Subdirectory '" << dirName << "' is not accessible.\n";
-            return nullptr; // Return nullptr if the subdirectory is inaccessible
-        }
-    }
-
-    // **Step 7: Return the Final Directory**
-    // After traversing all path components, return the final directory
-    return current;
+        break;
+    case Path_Resolver::Status::NotFound:
+        cout << "Error: Directory '" << result.component << "' not found in '" << result.at->getFullPath() << "'.\n";
+        break;
+    case Path_Resolver::Status::NotADirectory:
+        cout << "Error: '" << result.component << "' is not a directory.\n";
+        break;
+    case Path_Resolver::Status::AboveRoot:
+        cout << "Error: Already at the root directory.\n";
+        break;
+    case Path_Resolver::Status::WrongDrive:
+        cout << "Error: Drive '" << result.component << "' not found.\n";
+        break;
+    }
+    return nullptr;
 }
 
 // Handles the "dir" command to display the contents of a directory
@@ -1278,33 +1262,24 @@ void CommandProcessor::handleEcho(const string& filePath)
         }
     }
 
-    // Step 6: Check for duplicate files (case-insensitive comparison)
-    for (const auto& entry : parentDir->DirOrFiles) {
-        string existingName = toLower(entry.getName());
-        string newName = toLower(fileName);
-
-        if (existingName == newName) {
-            cout << "Error: File '" << fileName << "' already exists.\n";
-            return;
-        }
+    // Step 6: Check for duplicate files (case-insensitive, through the name index)
+    if (parentDir->findEntry(fileName) != -1) {
+        cout << "Error: File '" << fileName << "' already exists.\n";
+        return;
     }
 
     // Step 7: Create the file entry
     Directory_Entry newFileEntry(fileName, 0x00, 0); // 0x00 indicates a file
-    newFileEntry.setIsFile(true); // Mark the entry as a file
 
-    // Step 8: Add the new file to the parent directory
-    parentDir->DirOrFiles.push_back(newFileEntry);
+    // Step 8: Add the new file to the parent directory and persist it
+    parentDir->addEntry(newFileEntry);
 
-    // Step 9: Persist changes to the directory
-    parentDir->writeDirectory();
-
-    // Step 10: Confirm file creation
+    // Step 9: Confirm file creation
     cout << "File '" << newFileEntry.getName() << "' created successfully.\n";
 }
 
-// Handles the "write" command to write content to an existing file
-void CommandProcessor::handleWrite(const string& filePath)
+// Handles the "write" command to write content to an existing file, append to it, or patch it at 'offset' (-1 for none)
+void CommandProcessor::handleWrite(const string& filePath, bool append, long long offset)
 {
     // Step 1: Parse the path into parent directory and file name
     pair<string, string> pathParts = Parser::parsePath(filePath);
@@ -1337,46 +1312,73 @@ void CommandProcessor::handleWrite(const string& filePath)
         return;
     }
 
-    // Step 4: Search for the file in the parent directory
+    // Step 4: Search for the file in the parent directory (case-insensitive, through the name index)
     bool fileFound = false;
-    for (auto& entry : parentDir->DirOrFiles) // Iterate by reference to modify entries if needed
+    int entryIndex = parentDir->findEntry(fileName);
+    if (entryIndex != -1)
     {
-        string lowerFileName = toLower(fileName); // Convert input file name to lowercase
-        string entryName = toLower(entry.getName()); // Convert entry name to lowercase for comparison
+        Directory_Entry& entry = parentDir->DirOrFiles[entryIndex];
 
-        if (entryName == lowerFileName) // Case-insensitive match
+        // Step 5: Ensure the entry is a file
+        if (!entry.getIsFile())
         {
-            // Step 5: Ensure the entry is a file
-            if (!entry.getIsFile())
-            {
-                cout << "Error: '" << fileName << "' is a directory, not a file.\n";
-                return;
-            }
+            cout << "Error: '" << fileName << "' is a directory, not a file.\n";
+            return;
+        }
+
+        // Step 6: Prompt user for input to write to the file
+        cout << "Enter text to " << (append ? "append" : "write") << " to '" << fileName << "'. Type 'END in Capitl Only' on a new line to finish.\n";
 
-            // Step 6: Prompt user for input to write to the file
-            cout << "Enter text to write to '" << fileName << "'. Type 'END in Capitl Only' on a new line to finish.\n";
+        string line;
+        string newContent;
+        while (true)
+        {
+            getline(cin, line);
+            if (line == "END")
+                break;
+            newContent += line + "\n";
+        }
 
-            string line;
-            string newContent;
-            while (true)
+        // Step 7: Patch the bytes at the offset in place, touching only the clusters they fall in
+        if (offset >= 0)
+        {
+            File_Handle file;
+            file.open(entry, parentDir, File_Handle::Mode::Update);
+            if (offset > file.getSize())
             {
-                getline(cin, line);
-                if (line == "END")
-                    break;
-                newContent += line + "\n";
+                cout << "Error: Offset " << offset << " is past the end of '" << fileName << "' (" << file.getSize() << " bytes).\n";
+                return;
             }
+            // A short write has printed its error; closing still records what did land before returning
+            size_t written = file.writeAt(offset, span<const char>(newContent.data(), newContent.size()));
+            file.close();
+            if (written < newContent.size())
+                return;
+            cout << "Content written to '" << fileName << "' at offset " << offset << " successfully.\n";
+            return;
+        }
 
-            // Step 7: Update the file content
-            entry.setContent(newContent);
+        // Append in place from the file's tail cluster
+        if (append)
+        {
+            File_Handle file;
+            file.open(entry, parentDir, File_Handle::Mode::Append);
+            size_t written = file.write(span<const char>(newContent.data(), newContent.size()));
+            file.close();
+            if (written < newContent.size())
+                return;
+            cout << "Content appended to '" << fileName << "' successfully.\n";
+            return;
+        }
 
-            // Step 8: Persist the changes to disk
-            parentDir->writeDirectory();
+        // Step 8: Write the content to the file's clusters; the entry's size and first cluster follow
+        File_Entry file(entry, parentDir);
+        file.content = newContent;
+        file.writeFileContent();
 
-            // Step 9: Confirm success
-            cout << "Content written to '" << fileName << "' successfully.\n";
-            fileFound = true;
-            break;
-        }
+        // Step 9: Confirm success
+        cout << "Content written to '" << fileName << "' successfully.\n";
+        fileFound = true;
     }
 
     // Step 10: Handle case where the file is not found
@@ -1386,6 +1388,61 @@ void CommandProcessor::handleWrite(const string& filePath)
     }
 }
 
+// Streams 'content' into the file 'fileName' in 'dir', adding an empty entry for it first when there is none;
+// false if the name belongs to a directory or the disk filled up
+bool CommandProcessor::storeFile(Directory* dir, const string& fileName, istream& content)
+{
+    Directory_Entry newFile(fileName, 0x00, 0);
+    int index = dir->searchDirectory(newFile.getName());
+    if (index != -1 && !dir->DirOrFiles[index].getIsFile()) {
+        cout << "Error: '" << fileName << "' is a directory, not a file.\n";
+        return false;
+    }
+    if (index == -1) {
+        dir->addEntry(newFile);
+        index = dir->searchDirectory(newFile.getName());
+    }
+    content.seekg(0, ios::end);
+    long long size = static_cast<long long>(content.tellg());
+    content.seekg(0, ios::beg);
+    File_Handle file;
+    file.open(dir->DirOrFiles[index], dir, File_Handle::Mode::Write);
+    if (size > 0 && !file.reserve(size))
+        return false;
+    file.copyFrom(content);
+    return content.eof();
+}
+
+// Streams the content of 'source' in 'sourceDir' into the file at 'destIndex' of 'destDir', replacing what it held
+bool CommandProcessor::copyFileContent(const Directory_Entry& source, Directory* sourceDir, Directory* destDir, int destIndex)
+{
+    if (destIndex == -1)
+        return false;
+    const Directory_Entry& dest = destDir->DirOrFiles[destIndex];
+    // Emptying the destination first would lose the source when both are the same file (or share one chain)
+    if ((destDir == sourceDir && Directory::indexKey(dest) == Directory::indexKey(source))
+        || (dest.dir_firstCluster != 0 && dest.dir_firstCluster == source.dir_firstCluster)) {
+        cout << "Error: The file cannot be copied onto itself.\n";
+        return false;
+    }
+    File_Handle from;
+    File_Handle to;
+    from.open(source, sourceDir, File_Handle::Mode::Read);
+    to.open(dest, destDir, File_Handle::Mode::Write);
+    if (!to.reserve(from.getSize()))
+        return false;
+    return to.copyFrom(from) == from.getSize();
+}
+
+// Parses a non-negative decimal number given as a command option
+bool CommandProcessor::parseNumber(const string& text, long long& value)
+{
+    if (text.empty() || text.size() > 18 || !all_of(text.begin(), text.end(), [](char c) { return isdigit(static_cast<unsigned char>(c)) != 0; }))
+        return false;
+    value = stoll(text);
+    return true;
+}
+
 // Validates a file name based on specific rules
 bool CommandProcessor::isValidFileName(const string& name)
 {
@@ -1438,11 +1495,34 @@ bool CommandProcessor::isValidFileName(const string& name)
 }
 
 // Handles the "type" command to display the content of one or more files
-void CommandProcessor::handleType(const vector<string>& filePaths)
+void CommandProcessor::handleType(const vector<string>& args)
 {
+    // Leading -o and -n options select a byte range; the remaining arguments are the files
+    long long offset = 0;
+    long long length = LLONG_MAX;
+    size_t first = 0;
+    while (first + 1 < args.size() && (toLower(args[first]) == "-o" || toLower(args[first]) == "-n"))
+    {
+        long long value = 0;
+        if (!parseNumber(args[first + 1], value))
+        {
+            cout << "Error: '" << args[first + 1] << "' is not a valid " << (toLower(args[first]) == "-o" ? "offset" : "length") << ".\n";
+            return;
+        }
+        (toLower(args[first]) == "-o" ? offset : length) = value;
+        first += 2;
+    }
+    if (first == args.size())
+    {
+        cout << "Error: Invalid syntax for type command.\n";
+        cout << "Usage: type [-o offset] [-n length] [file_path]+ (one or more file paths)\n";
+        return;
+    }
+
     // Iterate over each file path provided in the command
-    for (const string& filePath : filePaths)
+    for (size_t i = first; i < args.size(); i++)
     {
+        const string& filePath = args[i];
         // Step 1: Parse the file path into parent directory and file name
         pair<string, string> pathParts = Parser::parsePath(filePath);
         string parentPath = pathParts.first;
@@ -1468,29 +1548,32 @@ void CommandProcessor::handleType(const vector<string>& filePaths)
             continue; // Skip to the next file
         }
 
-        // Step 3: Search for the file in the parent directory
+        // Step 3: Search for the file in the parent directory (case-insensitive, through the name index)
         bool fileFound = false;
-        for (const auto& entry : parentDir->DirOrFiles)
+        int entryIndex = parentDir->findEntry(fileName);
+        if (entryIndex != -1)
         {
-            // Perform case-insensitive comparison for the file name
-            string lowerFileName = toLower(fileName);
-            string entryName = toLower(entry.getName());
+            const Directory_Entry& entry = parentDir->DirOrFiles[entryIndex];
+            fileFound = true;
 
-            if (entryName == lowerFileName) // File found
+            // Step 4: Ensure the entry is a file and not a directory
+            if (!entry.getIsFile())
             {
-                // Step 4: Ensure the entry is a file and not a directory
-                if (!entry.getIsFile())
+                cout << "Error: '" << fileName << "' is a directory, not a file.\n";
+            }
+            else
+            {
+                // Step 5: Stream the file's clusters to the screen, starting at the cluster holding the offset
+                File_Handle file;
+                file.open(entry, parentDir, File_Handle::Mode::Read);
+                if (!file.seek(offset))
                 {
-                    cout << "Error: '" << fileName << "' is a directory, not a file.\n";
-                    fileFound = true; // Mark as found to avoid general not found message
-                    break;
+                    cout << "Error: Offset " << offset << " is past the end of '" << fileName << "' (" << file.getSize() << " bytes).\n";
+                    continue;
                 }
-
-                // Step 5: Display the file content
                 cout << "Content of '" << fileName << "':\n";
-                cout << entry.getContent() << "\n"; // retrieves file content
-                fileFound = true;
-                break;
+                file.copyTo(cout, length);
+                cout << "\n";
             }
         }
 
@@ -1502,6 +1585,89 @@ void CommandProcessor::handleType(const vector<string>& filePaths)
     }
 }
 
+// Handles the "head" and "tail" commands: shows the first or last 'lines' lines of a file
+void CommandProcessor::handleHeadTail(const string& filePath, long long lines, bool tail)
+{
+    // Step 1: Resolve the file
+    auto [parentPath, fileName] = Parser::parsePath(filePath);
+    Directory* parentDir = parentPath.empty() ? *currentDirectoryPtr : MoveToDir(parentPath);
+    if (parentDir == nullptr)
+    {
+        cout << "Error: Directory path '" << parentPath << "' does not exist.\n";
+        return;
+    }
+    int entryIndex = parentDir->findEntry(fileName);
+    if (entryIndex == -1)
+    {
+        cout << "Error: File '" << fileName << "' does not exist.\n";
+        return;
+    }
+    if (!parentDir->DirOrFiles[entryIndex].getIsFile())
+    {
+        cout << "Error: '" << fileName << "' is a directory, not a file.\n";
+        return;
+    }
+
+    File_Handle file;
+    file.open(parentDir->DirOrFiles[entryIndex], parentDir, File_Handle::Mode::Read);
+    vector<char> chunk(Virtual_Disk::getClusterSize());
+    long long size = file.getSize();
+    long long start = 0;
+    long long end = size;
+
+    if (!tail)
+    {
+        // Step 2 (head): read forwards until the last wanted line ends
+        long long position = 0;
+        long long found = 0;
+        while (found < lines && position < size)
+        {
+            size_t count = file.readAt(position, span<char>(chunk.data(), chunk.size()));
+            for (size_t i = 0; i < count && found < lines; i++)
+            {
+                if (chunk[i] == '\n' && ++found == lines)
+                    end = position + static_cast<long long>(i) + 1;
+            }
+            position += static_cast<long long>(count);
+        }
+        if (lines == 0)
+            end = 0;
+    }
+    else
+    {
+        // Step 2 (tail): read backwards a cluster at a time until the line before the first wanted one ends;
+        // a newline closing the file does not start another line
+        long long position = size > 0 && lines > 0 ? size - 1 : 0;
+        long long found = 0;
+        start = lines == 0 ? size : 0;
+        while (lines > 0 && position > 0)
+        {
+            long long chunkStart = max(0LL, position - static_cast<long long>(chunk.size()));
+            size_t count = file.readAt(chunkStart, span<char>(chunk.data(), static_cast<size_t>(position - chunkStart)));
+            for (size_t i = count; i-- > 0;)
+            {
+                if (chunk[i] == '\n' && ++found == lines)
+                {
+                    start = chunkStart + static_cast<long long>(i) + 1;
+                    break;
+                }
+            }
+            if (found == lines)
+                break;
+            position = chunkStart;
+        }
+    }
+
+    // Step 3: Stream the selected lines, ending them with a newline if the file does not
+    file.seek(start);
+    file.copyTo(cout, end - start);
+    char last = '\n';
+    if (end > start)
+        file.readAt(end - 1, span<char>(&last, 1));
+    if (last != '\n')
+        cout << "\n";
+}
+
 // Handles the "del" command to delete files or directories
 void CommandProcessor::handleDel(const vector<string>& targets)
 {
@@ -1576,10 +1742,12 @@ void CommandProcessor::handleDel(const vector<string>& targets)
 
                         if (tolower(confirmation[0]) == 'y')
                         {
+                            // deleteFile removes the entry from the directory; carry on from the same position
+                            size_t position = static_cast<size_t>(it - targetDir->DirOrFiles.begin());
                             File_Entry file(*it, targetDir);
                             file.deleteFile();
                             cout << "File '" << fileName << "' deleted successfully.\n";
-                            it = targetDir->DirOrFiles.erase(it); // Remove file from directory
+                            it = targetDir->DirOrFiles.begin() + position;
                         }
                         else
                         {
@@ -1592,7 +1760,6 @@ void CommandProcessor::handleDel(const vector<string>& targets)
                     }
                 }
 
-                targetDir->writeDirectory(); // Persist changes
                 cout << "All files in the directory '" << dirEntry->getName() << "' have been processed.\n";
             }
             else
@@ -1609,13 +1776,10 @@ void CommandProcessor::handleDel(const vector<string>& targets)
 
             if (tolower(confirmation[0]) == 'y')
             {
+                // deleteFile frees the clusters, removes the entry from DirOrFiles and persists the directory
                 File_Entry file(*dirEntry, parentDir);
                 file.deleteFile();
                 cout << "File '" << fileName << "' deleted successfully.\n";
-
-                // Remove from DirOrFiles and persist changes
-                parentDir->DirOrFiles.erase(parentDir->DirOrFiles.begin() + entryIndex);
-                parentDir->writeDirectory();
             }
             else
             {
@@ -1683,18 +1847,15 @@ void CommandProcessor::handleRename(const vector<string>& args)
     }
 
     // Step 6: Check for duplicate file names in the directory
-    for (const auto& entry : targetDir->DirOrFiles)
+    if (targetDir->findEntry(newFileName) != -1)
     {
-        if (toLower(entry.getName()) == toLower(newFileName))
-        {
-            cout << "Error: A file with the name '" << newFileName << "' already exists in the directory.\n";
-            return;
-        }
+        cout << "Error: A file with the name '" << newFileName << "' already exists in the directory.\n";
+        return;
     }
 
-    // Step 7: Rename the file
-    fileEntry.assignDir_Name(newFileName);
-    targetDir->writeDirectory(); // Persist the changes to the disk
+    // Step 7: Rename the file and persist the changes to the disk
+    if (!targetDir->renameEntry(fileIndex, newFileName))
+        return;
 
     // Step 8: Confirm the rename operation
     cout << "File '" << fileName << "' renamed to '" << newFileName << "' successfully.\n";
@@ -1747,7 +1908,7 @@ void CommandProcessor::handleCopy(const vector<string>& args)
         return;
     }
 
-    Directory_Entry& sourceEntry = sourceDir->DirOrFiles[sourceIndex]; // Reference to the source entry
+    Directory_Entry sourceEntry = sourceDir->DirOrFiles[sourceIndex]; // Copy of the source entry: adding the copy may move it
 
     // **Handle File Copying**
     if (sourceEntry.dir_attr == 0x00) // 0x00 indicates a file
@@ -1834,7 +1995,7 @@ void CommandProcessor::handleCopy(const vector<string>& args)
             {
                 // **Destination is a Directory**
                 destIsDirectory = true;
-                destinationDir = destinationDir->DirOrFiles[destIndex].subDirectory; // Move to the subdirectory
+                destinationDir = destinationDir->openSubDirectory(destIndex); // Move to the subdirectory
                 destFileName = sourceName; // Copy with the same name into the destination directory
             }
         }
@@ -1861,8 +2022,11 @@ void CommandProcessor::handleCopy(const vector<string>& args)
                 }
 
                 // **Overwrite Existing File**
-                Directory_Entry& existingEntry = destinationDir->DirOrFiles[existingIndex];
-                existingEntry = sourceEntry; // Assuming shallow copy is sufficient
+                if (!copyFileContent(sourceEntry, sourceDir, destinationDir, existingIndex))
+                {
+                    cout << "0 file(s) copied.\n";
+                    return;
+                }
                 cout << "File '" << sourceName << "' overwritten successfully in the destination directory.\n";
                 cout << "1 file(s) copied.\n";
                 return;
@@ -1870,7 +2034,9 @@ void CommandProcessor::handleCopy(const vector<string>& args)
 
             // **Destination File Does Not Exist - Proceed to Copy**
             Directory_Entry newFileEntry = sourceEntry;
-            newFileEntry.assignDir_Name(sourceName); // Assign the same name
+            newFileEntry.assignDir_Name(sourceName);
+            newFileEntry.dir_firstCluster = 0; // The copy gets clusters of its own when its content is streamed in
+            newFileEntry.dir_fileSize = 0; // Assign the same name
 
             if (!destinationDir->canAddEntry(newFileEntry))
             {
@@ -1881,6 +2047,12 @@ void CommandProcessor::handleCopy(const vector<string>& args)
             }
 
             destinationDir->addEntry(newFileEntry); // Add the new file to the destination directory
+            if (!copyFileContent(sourceEntry, sourceDir, destinationDir, destinationDir->searchDirectory(newFileEntry.getName())))
+            {
+                destinationDir->removeEntry(newFileEntry); // Leave no empty file behind
+                cout << "0 file(s) copied.\n";
+                return;
+            }
             cout << "File '" << sourceName << "' copied successfully to the destination directory.\n";
             cout << "1 file(s) copied.\n";
             return;
@@ -1915,8 +2087,11 @@ void CommandProcessor::handleCopy(const vector<string>& args)
                 }
 
                 // **Overwrite Existing File**
-                Directory_Entry& existingEntry = destinationDir->DirOrFiles[destIndex];
-                existingEntry = sourceEntry; // Assuming shallow copy is sufficient
+                if (!copyFileContent(sourceEntry, sourceDir, destinationDir, destIndex))
+                {
+                    cout << "0 file(s) copied.\n";
+                    return;
+                }
                 cout << "File '" << destFileName << "' overwritten successfully.\n";
                 cout << "1 file(s) copied.\n";
                 return;
@@ -1924,7 +2099,9 @@ void CommandProcessor::handleCopy(const vector<string>& args)
 
             // **Destination File Does Not Exist - Proceed to Copy**
             Directory_Entry newFileEntry = sourceEntry;
-            newFileEntry.assignDir_Name(destFileName); // Assign the new file name
+            newFileEntry.assignDir_Name(destFileName);
+            newFileEntry.dir_firstCluster = 0; // The copy gets clusters of its own when its content is streamed in
+            newFileEntry.dir_fileSize = 0; // Assign the new file name
 
             if (!destinationDir->canAddEntry(newFileEntry))
             {
@@ -1935,6 +2112,12 @@ void CommandProcessor::handleCopy(const vector<string>& args)
             }
 
             destinationDir->addEntry(newFileEntry); // Add the new file to the destination directory
+            if (!copyFileContent(sourceEntry, sourceDir, destinationDir, destinationDir->searchDirectory(newFileEntry.getName())))
+            {
+                destinationDir->removeEntry(newFileEntry); // Leave no empty file behind
+                cout << "0 file(s) copied.\n";
+                return;
+            }
             cout << "File '" << sourceName << "' copied successfully as '" << destFileName << "'.\n";
             cout << "1 file(s) copied.\n";
             return;
@@ -1991,7 +2174,7 @@ void CommandProcessor::handleCopy(const vector<string>& args)
             {
                 // **Destination is an Existing Directory**
                 destIsDirectory = true;
-                destinationDir = destinationDir->DirOrFiles[destIndex].subDirectory; // Move to the subdirectory
+                destinationDir = destinationDir->openSubDirectory(destIndex); // Move to the subdirectory
             }
             else if (destIndex != -1 && destinationDir->DirOrFiles[destIndex].dir_attr != 0x10)
             {
@@ -2009,7 +2192,8 @@ void CommandProcessor::handleCopy(const vector<string>& args)
 
         // **Iterate Through Source Directory Entries and Copy Files**
         int filesCopied = 0; // Counter for the number of files copied
-        for (const auto& entry : sourceEntry.subDirectory->DirOrFiles)
+        Directory* sourceSubDir = sourceDir->openSubDirectory(sourceIndex);
+        for (const auto& entry : sourceSubDir->DirOrFiles)
         {
             if (entry.dir_attr == 0x00) // Only Copy Files (0x00 indicates a file)
             {
@@ -2032,8 +2216,10 @@ void CommandProcessor::handleCopy(const vector<string>& args)
                     }
 
                     // **Overwrite Existing File**
-                    Directory_Entry& existingEntry = destinationDir->DirOrFiles[destIndex];
-                    existingEntry = entry; // Assuming shallow copy is sufficient
+                    if (!copyFileContent(entry, sourceSubDir, destinationDir, destIndex))
+                    {
+                        continue;
+                    }
                     cout << "File '" << srcFileName << "' overwritten successfully in destination directory.\n";
                     filesCopied++;
                     continue;
@@ -2041,7 +2227,9 @@ void CommandProcessor::handleCopy(const vector<string>& args)
 
                 // **Destination File Does Not Exist - Proceed to Copy**
                 Directory_Entry newFileEntry = entry;
-                newFileEntry.assignDir_Name(srcFileName); // Assign the same name
+                newFileEntry.assignDir_Name(srcFileName);
+                newFileEntry.dir_firstCluster = 0; // The copy gets clusters of its own when its content is streamed in
+                newFileEntry.dir_fileSize = 0; // Assign the same name
 
                 if (!destinationDir->canAddEntry(newFileEntry))
                 {
@@ -2051,6 +2239,11 @@ void CommandProcessor::handleCopy(const vector<string>& args)
                 }
 
                 destinationDir->addEntry(newFileEntry); // Add the new file to the destination directory
+                if (!copyFileContent(entry, sourceSubDir, destinationDir, destinationDir->searchDirectory(newFileEntry.getName())))
+                {
+                    destinationDir->removeEntry(newFileEntry); // Leave no empty file behind
+                    continue;
+                }
                 cout << "File '" << srcFileName << "' copied successfully to destination directory.\n";
                 filesCopied++;
             }
@@ -2138,33 +2331,18 @@ void CommandProcessor::handleImport(const vector<string>& args) {
             }
         }
 
-        // **Read the content of the source file**
+        // **Open the source file**
         ifstream inputFile(sourcePath, ios::binary);
         if (!inputFile.is_open()) {
             cout << "Error: Unable to open source file '" << sourcePath.string() << "'. Skipping import.\n";
             return; // Skip if the file cannot be opened
         }
-        string fileContent((istreambuf_iterator<char>(inputFile)), istreambuf_iterator<char>());
-        inputFile.close();
 
-        // **Create a new Directory_Entry for the file**
-        Directory_Entry newFile(fileName, 0x00, static_cast<int>(fileContent.size()));
-        newFile.setIsFile(true); // Mark it as a file
-        newFile.setContent(fileContent); // Set the file content
-
-        // **Add or overwrite the file in the virtual disk**
-        if (fileExists) {
-            // Overwrite the existing file
-            for (auto& entry : targetDir->DirOrFiles) {
-                if (entry.getName() == fileName && entry.getIsFile()) {
-                    entry = newFile; // Replace the existing entry
-                    break;
-                }
-            }
+        // **Stream the file into the virtual disk, adding or overwriting it**
+        if (!storeFile(targetDir, fileName, inputFile)) {
+            return;
         }
-        else {
-            // Add the new file to the directory
-            targetDir->addEntry(newFile);
+        if (!fileExists) {
             importedFiles.push_back(fileName); // Track the imported file
         }
 
@@ -2201,31 +2379,18 @@ void CommandProcessor::handleImport(const vector<string>& args) {
                     }
                 }
 
-                // **Read the content of the source file**
+                // **Open the source file**
                 ifstream inputFile(entry.path(), ios::binary);
                 if (!inputFile.is_open()) {
                     cout << "Error: Unable to open source file '" << entry.path().string() << "'. Skipping import.\n";
                     continue; // Skip if the file cannot be opened
                 }
-                string fileContent((istreambuf_iterator<char>(inputFile)), istreambuf_iterator<char>());
-                inputFile.close();
-
-                // **Create a new Directory_Entry for the file**
-                Directory_Entry newFile(fileName, 0x00, static_cast<int>(fileContent.size()));
-                newFile.setIsFile(true); // Mark it as a file
-                newFile.setContent(fileContent); // Set the file content
 
-                // **Add or overwrite the file in the virtual disk**
-                if (fileExists) {
-                    for (auto& dirEntry : (*currentDirectoryPtr)->DirOrFiles) {
-                        if (dirEntry.getName() == fileName && dirEntry.getIsFile()) {
-                            dirEntry = newFile; // Replace the existing entry
-                            break;
-                        }
-                    }
+                // **Stream the file into the virtual disk, adding or overwriting it**
+                if (!storeFile(*currentDirectoryPtr, fileName, inputFile)) {
+                    continue;
                 }
-                else {
-                    (*currentDirectoryPtr)->addEntry(newFile); // Add the new file
+                if (!fileExists) {
                     importedFiles.push_back(fileName); // Track the imported file
                 }
 
@@ -2278,6 +2443,8 @@ void CommandProcessor::handleExport(const vector<string>& args)
     // Get the current directory pointer
     Directory* currentDir = *currentDirectoryPtr;
     Directory_Entry* sourceEntry = nullptr;
+    Directory* sourceParent = nullptr;
+    int sourceIndex = -1;
 
     // **Check if the source path is absolute**
     // An absolute path typically starts with a drive letter (e.g., "C:\")
@@ -2308,6 +2475,8 @@ void CommandProcessor::handleExport(const vector<string>& args)
 
         // Get the entry from the resolved directory
         sourceEntry = &resolvedDir->DirOrFiles[entryIndex];
+        sourceParent = resolvedDir;
+        sourceIndex = entryIndex;
     }
     else
     {
@@ -2321,6 +2490,8 @@ void CommandProcessor::handleExport(const vector<string>& args)
 
         // Get the entry from the current directory
         sourceEntry = &currentDir->DirOrFiles[entryIndex];
+        sourceParent = currentDir;
+        sourceIndex = entryIndex;
     }
 
     int exportedFiles = 0; // Counter to keep track of the number of files exported
@@ -2328,9 +2499,8 @@ void CommandProcessor::handleExport(const vector<string>& args)
     // **Handle directory export**
     if (sourceEntry->dir_attr == 0x10) // Check if the source entry is a directory
     {
-        // Create a Directory object for the source directory
-        Directory sourceDir(sourceEntry->getName(), sourceEntry->dir_attr, sourceEntry->dir_firstCluster, currentDir);
-        sourceDir.readDirectory(); // Read the contents of the directory
+        // Open the source directory through the mounted tree (loaded from disk on first use)
+        Directory& sourceDir = *sourceParent->openSubDirectory(sourceIndex);
 
         // Iterate over each entry in the source directory
         for (const auto& entry : sourceDir.DirOrFiles)
@@ -2338,10 +2508,6 @@ void CommandProcessor::handleExport(const vector<string>& args)
             // Only export files (skip subdirectories)
             if (entry.dir_attr != 0x10)
             {
-                // Create a File_Entry object for the file
-                File_Entry file(entry, &sourceDir);
-                file.readFileContent(); // Read the content of the file
-
                 // Construct the destination file path
                 string destinationFilePath = (filesystem::path(destinationPath) / entry.getName()).string();
 
@@ -2368,8 +2534,10 @@ void CommandProcessor::handleExport(const vector<string>& args)
                     continue;
                 }
 
-                // Write the file content to the destination file
-                outFile.write(file.content.c_str(), file.content.size());// Converts the content (stored as a std::string) into a C-style string pointer.
+                // Stream the file content to the destination file
+                File_Handle file;
+                file.open(entry, &sourceDir, File_Handle::Mode::Read);
+                file.copyTo(outFile);
                 outFile.close();
 
                 exportedFiles++; // Increment the exported files counter
@@ -2384,10 +2552,6 @@ void CommandProcessor::handleExport(const vector<string>& args)
     // **Handle single file export**
     if (sourceEntry->dir_attr != 0x10) // Check if the source entry is a file
     {
-        // Create a File_Entry object for the file
-        File_Entry file(*sourceEntry, currentDir);
-        file.readFileContent(); // Read the content of the file
-
         // Determine the destination file path
         string destinationFilePath = destinationPath;
         if (filesystem::is_directory(destinationPath))
@@ -2418,8 +2582,10 @@ void CommandProcessor::handleExport(const vector<string>& args)
             return;
         }
 
-        // Write the file content to the destination file
-        outFile.write(file.content.c_str(), file.content.size());
+        // Stream the file content to the destination file
+        File_Handle file;
+        file.open(*sourceEntry, sourceParent, File_Handle::Mode::Read);
+        file.copyTo(outFile);
         outFile.close();
 
         exportedFiles++; // Increment the exported files counter
@@ -43,14 +43,20 @@ private:
     void handleHistory();
     void handleDir(const string& path);
     void handleEcho(const string& filePath);
-    void handleWrite(const string& filePath);
+    void handleWrite(const string& filePath, bool append, long long offset);
     bool isValidFileName(const string& name);
-    void handleType(const vector<string>& filePaths);
+    bool storeFile(Directory* dir, const string& fileName, istream& content);
+    bool copyFileContent(const Directory_Entry& source, Directory* sourceDir, Directory* destDir, int destIndex);
+    void handleType(const vector<string>& args);
+    void handleHeadTail(const string& filePath, long long lines, bool tail);
+    bool parseNumber(const string& text, long long& value);
     void handleDel(const vector<string>& targets);
     void handleRename(const vector<string>& args);
     void handleCopy(const vector<string>& args);
     void handleImport(const  vector< string>& args);
     void handleExport(const vector<string>& args);
+    void handleStats();
+    void handleDedupStats();
 
     // **Directory and File Navigation**
     
@@ -64,6 +70,8 @@ private:
     unordered_map<string, pair<string, string>> commandHelp;
     Directory** currentDirectoryPtr;
     Directory* currentDir;
+    // FAT clusters written by the previous command, reported by `stats`
+    long long lastCommandFATWrites = 0;
     
 
 
@@ -1,6 +1,18 @@
 #include "Converter.h"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
 using namespace std;
 
+static_assert(sizeof(int) == 4, "the on-disk integers are 32-bit");
+
+// Reverses the byte order of a 32-bit value
+static uint32_t swapBytes(uint32_t v)
+{
+    return (v >> 24) | ((v >> 8) & 0x0000FF00u) | ((v << 8) & 0x00FF0000u) | (v << 24);
+}
+
 // Convert an integer to a 4-byte vector in little-endian format
 vector<char> Converter::intToByte(int n)
 {
@@ -15,8 +27,9 @@ vector<char> Converter::intToByte(int n)
 // Convert a 4-byte vector to an integer (little-endian format)
 int Converter::byteToInt(vector<char> bytes)
 {
+    // The lowest byte comes first, mirroring intToByte
     int n = 0;
-    for (int i = 0; i < bytes.size(); ++i)
+    for (int i = static_cast<int>(bytes.size()) - 1; i >= 0; --i)
     {
         n = (n << 8) | (bytes[i] & 0xFF);
     }
@@ -26,167 +39,163 @@ int Converter::byteToInt(vector<char> bytes)
 // Convert an array of integers to a continuous byte array
 vector<char> Converter::intArrayToByteArray(int* ints, int size)
 {
-    vector<char> bytes;
-    for (int i = 0; i < size; i++)
-    {
-        vector<char> b = Converter::intToByte(ints[i]);
-        bytes.insert(bytes.end(), b.begin(), b.end());
-    }
+    vector<char> bytes(static_cast<size_t>(size) * 4);
+    intsToLittleEndian(bytes, span<const int>(ints, static_cast<size_t>(size)));
     return bytes;
 }
 
 // Convert a byte array back into an array of integers
 void Converter::byteArrayToIntArray(int* ints, vector<char> bytes)
 {
-    for (int i = 0, j = 0; i < bytes.size() && j < bytes.size() /
-        sizeof(int); j++, i += 4)
+    size_t count = bytes.size() / 4;
+    memcpy(ints, bytes.data(), count * 4);
+    fromLittleEndian(span<int>(ints, count));
+}
+
+void Converter::fromLittleEndian(span<int> ints)
+{
+    if constexpr (endian::native != endian::little)
     {
-        vector<char> b;
-        for (int k = i; k < (i + 4); k++)
-        {
-            b.push_back(bytes[k]);
-        }
-        ints[j] = Converter::byteToInt(b);
+        for (int& n : ints)
+            n = static_cast<int>(swapBytes(static_cast<uint32_t>(n)));
     }
 }
 
-// Split a byte vector into 1024-byte chunks, padding the last chunk if necessary
-vector<vector<char>> Converter::splitBytes(vector<char> bytes)
+void Converter::intsToLittleEndian(span<char> bytes, span<const int> ints)
 {
-    vector<vector<char>> ls;
-    if (bytes.size() > 0)
+    if constexpr (endian::native == endian::little)
     {
-        int number_of_arrays = bytes.size() / 1024;
-        int rem = bytes.size() % 1024;
-        for (int i = 0; i < number_of_arrays; i++)
-        {
-            vector<char> b;
-            for (int j = i * 1024, k = 0; k < 1024; j++, k++)
-            {
-                b.push_back(bytes[j]);
-            }
-            ls.push_back(b);
-        }
-        if (rem > 0)
-        {
-            vector<char> b1(1024);
-            for (int i = number_of_arrays * 1024, k = 0; k < rem;
-                i++, k++)
-            {
-                b1.push_back(bytes[i]);
-            }
-            for (int i = rem; i < 1024; i++)
-            {
-                b1.push_back(0);
-            }
-            ls.push_back(b1);
-        }
+        memcpy(bytes.data(), ints.data(), ints.size_bytes());
     }
     else
     {
-        vector<char> b1(1024);
-        for (int i = 0; i < 1024; i++)
+        for (size_t i = 0; i < ints.size(); i++)
         {
-            b1.push_back(0);
+            uint32_t v = swapBytes(static_cast<uint32_t>(ints[i]));
+            memcpy(bytes.data() + i * 4, &v, 4);
         }
-        ls.push_back(b1);
     }
-    return ls;
 }
 
-
-Directory_Entry Converter::BytesToDirectory_Entry(vector<char> bytes)
+// Split a byte vector into cluster-sized chunks, padding the last chunk with zeros if necessary
+vector<vector<char>> Converter::splitBytes(vector<char> bytes)
 {
-    string name = "";
-    for (int i = 0; i < 11; i++)
-    {
-        name += bytes[i];
-    }
-    char attr = bytes[11];
-    char empty[12];
-    int j = 12;
-    for (int i = 0; i < 12; i++)
-    {
-        empty[i] = bytes[j];
-        j++;
-    }
-    vector<char> fc(4);
-    for (int i = 0; i < fc.size(); i++)
-    {
-        fc.push_back(bytes[j]);
-        j++;
-    }
-    int firstcluster = Converter::byteToInt(fc);
-    vector<char> sz(4);
-    for (int i = 0; i < sz.size(); i++)
-    {
-        sz.push_back(bytes[j]);
-        j++;
-    }
-    int filesize = Converter::byteToInt(sz);
-    Directory_Entry d(name, attr, firstcluster);
-    for (int i = 0; i < 12; i++)
+    size_t clusterSize = static_cast<size_t>(Mini_FAT::getClusterSize());
+    vector<vector<char>> ls;
+
+    // An empty vector still yields one zeroed cluster
+    size_t number_of_arrays = max<size_t>(1, (bytes.size() + clusterSize - 1) / clusterSize);
+    for (size_t i = 0; i < number_of_arrays; i++)
     {
-        d.dir_empty[i] = empty[i];
+        vector<char> b(clusterSize, 0);
+        size_t first = i * clusterSize;
+        if (first < bytes.size())
+            copy(bytes.begin() + first, bytes.begin() + min(bytes.size(), first + clusterSize), b.begin());
+        ls.push_back(b);
     }
+    return ls;
+}
+
+
+// Converts a 32-bit value between host order and the little-endian order of the records
+static uint32_t littleEndian(uint32_t v)
+{
+    if constexpr (endian::native == endian::little)
+        return v;
+    else
+        return swapBytes(v);
+}
+
+void Converter::RecordToDirectory_Entry(const Directory_Record& r, Directory_Entry& d)
+{
+    memcpy(d.dir_name, r.name, sizeof(r.name));
+    d.dir_attr = r.attr;
+    memcpy(d.dir_empty, r.reserved, sizeof(r.reserved));
+    d.dir_firstCluster = static_cast<int>(littleEndian(r.firstCluster));
+
+    // The low half is unsigned; older formats never store more than 2 GiB in it
+    long long filesize = littleEndian(r.size);
+    if (Mini_FAT::hasLargeFiles())
+        filesize |= static_cast<long long>(littleEndian(r.sizeHigh)) << 32;
     d.dir_fileSize = filesize;
-    return d;
 }
 
+void Converter::Directory_EntryToRecord(const Directory_Entry& d, Directory_Record& r)
+{
+    memcpy(r.name, d.dir_name, sizeof(r.name));
+    r.attr = d.dir_attr;
+    memcpy(r.reserved, d.dir_empty, sizeof(r.reserved));
+    // Older formats keep those four bytes reserved, and blank like the rest
+    if (Mini_FAT::hasLargeFiles())
+        r.sizeHigh = littleEndian(static_cast<uint32_t>(static_cast<unsigned long long>(d.dir_fileSize) >> 32));
+    else
+        memset(&r.sizeHigh, ' ', sizeof(r.sizeHigh));
+    r.firstCluster = littleEndian(static_cast<uint32_t>(d.dir_firstCluster));
+    r.size = littleEndian(static_cast<uint32_t>(d.dir_fileSize & 0xFFFFFFFF));
+}
 
+void Converter::encodeDirectory(const vector<Directory_Entry>& entries, span<char> out)
+{
+    size_t count = min(entries.size(), out.size() / sizeof(Directory_Record));
+    Directory_Record* records = reinterpret_cast<Directory_Record*>(out.data());
+    for (size_t i = 0; i < count; i++)
+        Directory_EntryToRecord(entries[i], records[i]);
+    memset(out.data() + count * sizeof(Directory_Record), 0, out.size() - count * sizeof(Directory_Record));
+}
 
-vector<char> Converter::Directory_EntryToBytes(Directory_Entry d)
+size_t Converter::decodeDirectory(span<const char> bytes, vector<Directory_Entry>& out, vector<int>* slots)
 {
-    vector<char> bytes(32);
-    for (int j = 0; j < 11; j++)
-    {
-        bytes.push_back(d.dir_name[j]);
-    }
-    bytes.push_back(d.dir_attr);
-    for (int i = 0; i < 12; i++)
-    {
-        bytes.push_back(d.dir_empty[i]);
-    }
-    vector<char> fc = Converter::intToByte(d.dir_firstCluster);
-    for (int i = 0; i < fc.size(); i++)
-    {
-        bytes.push_back(fc[i]);
-    }
-    vector<char> sz = Converter::intToByte(d.dir_fileSize);
-    for (int i = 0; i < sz.size(); i++)
+    const Directory_Record* records = reinterpret_cast<const Directory_Record*>(bytes.data());
+    size_t total = bytes.size() / sizeof(Directory_Record);
+    size_t end = 0;
+    size_t live = 0;
+    while (end < total && records[end].name[0] != 0)
     {
-        bytes.push_back(sz[i]);
+        if (static_cast<unsigned char>(records[end].name[0]) != DELETED_RECORD)
+            live++;
+        end++;
     }
-    return bytes;
+
+    out.reserve(out.size() + live);
+    if (slots != nullptr)
+        slots->reserve(slots->size() + live);
+    for (size_t i = 0; i < end; i++)
+    {
+        if (static_cast<unsigned char>(records[i].name[0]) == DELETED_RECORD)
+            continue;
+        RecordToDirectory_Entry(records[i], out.emplace_back());
+        if (slots != nullptr)
+            slots->push_back(static_cast<int>(i));
+    }
+    return end;
 }
 
+Directory_Entry Converter::BytesToDirectory_Entry(vector<char> bytes)
+{
+    Directory_Entry d;
+    RecordToDirectory_Entry(*reinterpret_cast<const Directory_Record*>(bytes.data()), d);
+    return d;
+}
+
+vector<char> Converter::Directory_EntryToBytes(Directory_Entry d)
+{
+    vector<char> bytes(sizeof(Directory_Record));
+    Directory_EntryToRecord(d, *reinterpret_cast<Directory_Record*>(bytes.data()));
+    return bytes;
+}
 
 vector<char> Converter::Directory_EntriesToBytes(vector<Directory_Entry>d)
 {
-    vector<char> bytes(d.size() * 32);
-    for (int i = 0; i < d.size(); i++)
-    {
-        vector<char> b = Converter::Directory_EntryToBytes(d[i]);
-        bytes.insert(bytes.end(), b.begin(), b.end());
-    }
+    vector<char> bytes(d.size() * sizeof(Directory_Record));
+    encodeDirectory(d, bytes);
     return bytes;
 }
 
 vector<Directory_Entry> Converter::BytesToDirectory_Entries(vector<char>
     bytes)
 {
-    vector<Directory_Entry> DirsFiles(bytes.size() / 32);
-    for (int i = 0; i < bytes.size(); i += 32)
-    {
-        vector<char> b;
-        for (int j = i; j < (i + 32); j++)
-        {
-            b.push_back(bytes[j]);
-        }
-        if (b[0] == 0)
-            break;
-        DirsFiles.push_back(Converter::BytesToDirectory_Entry(b));
-    }
+    vector<Directory_Entry> DirsFiles;
+    decodeDirectory(bytes, DirsFiles);
     return DirsFiles;
 }
 
@@ -1,7 +1,9 @@
 #pragma once
 #include "Directory_Entry.h"
+#include "Directory_Record.h"
 #include "Virtual_Disk.h"
 #include "Mini_FAT.h"
+#include <span>
 #include <vector>
 #include <string>
 using namespace std;
@@ -21,7 +23,13 @@ public:
     // Converts a byte array back to an array of integers
     static void byteArrayToIntArray(int* ints,  vector<char> bytes);
 
-    // Splits a byte vector into chunks of 1024 bytes (pads if necessary)
+    // Converts 32-bit values read from disk (little-endian) to host order in place; nothing to do on little-endian hosts
+    static void fromLittleEndian(span<int> ints);
+
+    // Stores integers as little-endian 32-bit values with one bulk copy (a byte-swapping loop on big-endian hosts)
+    static void intsToLittleEndian(span<char> bytes, span<const int> ints);
+
+    // Splits a byte vector into cluster-sized chunks (pads if necessary)
     static vector<vector<char>> splitBytes( vector<char> bytes);
 
     // Converts a byte vector to a Directory_Entry object
@@ -34,6 +42,20 @@ public:
 
     static vector<Directory_Entry> BytesToDirectory_Entries(vector<char> bytes);
 
+    // Fills an entry from an on-disk record, which may be read in place from a cluster buffer
+    static void RecordToDirectory_Entry(const Directory_Record& r, Directory_Entry& d);
+
+    // Fills an on-disk record from an entry
+    static void Directory_EntryToRecord(const Directory_Entry& d, Directory_Record& r);
+
+    // Encodes the entries one record after another straight into 'out' (cluster buffers), zeroing the slots after them
+    static void encodeDirectory(const vector<Directory_Entry>& entries, span<char> out);
+
+    // Appends the entries recorded in 'bytes' to 'out', reading the records in place, skipping deleted ones and stopping
+    // at the first free slot. When 'slots' is given it receives each appended entry's slot number. Returns the number
+    // of slots before the end of the directory, deleted ones included.
+    static size_t decodeDirectory(span<const char> bytes, vector<Directory_Entry>& out, vector<int>* slots = nullptr);
+
     static vector<char> StringToBytes(string s);
     
     static string BytesToString(vector<char> b);
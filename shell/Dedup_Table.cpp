@@ -0,0 +1,279 @@
+#include "Dedup_Table.h"
+#include "Converter.h"
+#include "Virtual_Disk.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+vector<Dedup_Table::Record> Dedup_Table::records;
+vector<size_t> Dedup_Table::freeSlots;
+unordered_multimap<uint64_t, size_t> Dedup_Table::byHash;
+unordered_map<int, size_t> Dedup_Table::byCluster;
+vector<bool> Dedup_Table::dirtyClusters;
+Extent_Map Dedup_Table::chain;
+long long Dedup_Table::chains = 0;
+long long Dedup_Table::references = 0;
+long long Dedup_Table::savedClusters = 0;
+
+static const uint64_t PRIME_1 = 0x9E3779B185EBCA87ull;
+static const uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4Full;
+
+static uint64_t rotateLeft(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+void Dedup_Table::load()
+{
+    records.clear();
+    freeSlots.clear();
+    byHash.clear();
+    byCluster.clear();
+    dirtyClusters.clear();
+    chain.clear();
+    chains = 0;
+    references = 0;
+    savedClusters = 0;
+    chain.load(Mini_FAT::getDedupTableCluster());
+    if (chain.getClusterCount() == 0)
+        return;
+
+    size_t clusterSize = Virtual_Disk::getClusterSize();
+    vector<int> words(static_cast<size_t>(chain.getClusterCount()) * clusterSize / sizeof(int));
+    Virtual_Disk::readClusters(chain.getClusters(), span<char>(reinterpret_cast<char*>(words.data()), words.size() * sizeof(int)));
+    Converter::fromLittleEndian(span<int>(words));
+    records.resize(words.size() * sizeof(int) / RECORD_SIZE);
+    dirtyClusters.assign(static_cast<size_t>(chain.getClusterCount()), false);
+    for (size_t slot = records.size(); slot-- > 0;)
+    {
+        const int* w = words.data() + slot * 4;
+        Record& record = records[slot];
+        record.hash = static_cast<uint32_t>(w[0]) | (static_cast<uint64_t>(static_cast<uint32_t>(w[1])) << 32);
+        record.cluster = w[2];
+        record.references = w[3] & MAX_REFERENCES;
+        record.clusters = static_cast<int>(static_cast<uint32_t>(w[3]) >> 24);
+        if (record.cluster == 0)
+        {
+            // Highest slots first, so the lowest free one is reused first
+            freeSlots.push_back(slot);
+            continue;
+        }
+        byHash.emplace(record.hash, slot);
+        byCluster[record.cluster] = slot;
+        count(record, 1);
+    }
+}
+
+void Dedup_Table::sync()
+{
+    size_t clusterSize = Virtual_Disk::getClusterSize();
+    size_t perCluster = clusterSize / RECORD_SIZE;
+
+    // Clusters at the end of the table holding free slots only go back to the disk, the whole table once it is empty
+    size_t used = records.size();
+    while (used > 0 && records[used - 1].cluster == 0)
+        used--;
+    size_t keep = (used + perCluster - 1) / perCluster;
+    if (keep < static_cast<size_t>(chain.getClusterCount()))
+    {
+        if (keep == 0)
+        {
+            chain.freeAll();
+            Mini_FAT::setDedupTableCluster(0);
+        }
+        else
+        {
+            chain.truncate(static_cast<int>(keep));
+        }
+        records.resize(keep * perCluster);
+        freeSlots.erase(remove_if(freeSlots.begin(), freeSlots.end(), [](size_t slot) { return slot >= records.size(); }), freeSlots.end());
+        dirtyClusters.resize(min(dirtyClusters.size(), keep));
+    }
+
+    vector<int> clusters;
+    vector<int> words(clusterSize / sizeof(int));
+    vector<char> bytes(clusterSize);
+    for (size_t index = 0; index < dirtyClusters.size(); index++)
+    {
+        if (!dirtyClusters[index])
+            continue;
+        if (clusters.empty())
+            clusters = chain.getClusters();
+        fill(words.begin(), words.end(), 0);
+        for (size_t i = 0; i < perCluster && index * perCluster + i < records.size(); i++)
+        {
+            const Record& record = records[index * perCluster + i];
+            if (record.cluster == 0)
+                continue;
+            words[i * 4] = static_cast<int>(static_cast<uint32_t>(record.hash));
+            words[i * 4 + 1] = static_cast<int>(static_cast<uint32_t>(record.hash >> 32));
+            words[i * 4 + 2] = record.cluster;
+            words[i * 4 + 3] = static_cast<int>(static_cast<uint32_t>(record.references) | (static_cast<uint32_t>(record.clusters) << 24));
+        }
+        Converter::intsToLittleEndian(span<char>(bytes), span<const int>(words));
+        Virtual_Disk::writeCluster(span<const char>(bytes), clusters[index]);
+        dirtyClusters[index] = false;
+    }
+}
+
+uint64_t Dedup_Table::hash(span<const char> data)
+{
+    // Eight bytes at a time, multiplied and rotated in, then mixed down so every input bit reaches every output bit.
+    // Words are read in host order: on a host of the other byte order old chains are simply not matched again
+    const char* p = data.data();
+    size_t size = data.size();
+    uint64_t h = PRIME_1 ^ (static_cast<uint64_t>(size) * PRIME_2);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, p + i, sizeof(word));
+        h = rotateLeft(h ^ (word * PRIME_2), 31) * PRIME_1;
+    }
+    for (; i < size; i++)
+        h = rotateLeft(h ^ (static_cast<unsigned char>(p[i]) * PRIME_1), 11) * PRIME_2;
+    h ^= h >> 33;
+    h *= PRIME_2;
+    h ^= h >> 29;
+    h *= PRIME_1;
+    h ^= h >> 32;
+    return h;
+}
+
+int Dedup_Table::find(uint64_t hash, span<const char> data)
+{
+    // Equal hashes are only a hint: the candidate chain is read back and compared
+    size_t clusterSize = Virtual_Disk::getClusterSize();
+    int clusters = static_cast<int>((data.size() + clusterSize - 1) / clusterSize);
+    vector<char> bytes;
+    auto range = byHash.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        const Record& record = records[it->second];
+        if (record.clusters != clusters)
+            continue;
+        Extent_Map candidate;
+        candidate.load(record.cluster);
+        if (candidate.getClusterCount() != clusters)
+            continue;
+        bytes.resize(data.size());
+        Virtual_Disk::readClusters(candidate.getClusters(), span<char>(bytes));
+        if (memcmp(bytes.data(), data.data(), data.size()) == 0)
+            return record.cluster;
+    }
+    return -1;
+}
+
+void Dedup_Table::add(uint64_t hash, int cluster, int clusters)
+{
+    size_t slot = records.size();
+    if (!freeSlots.empty())
+    {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    else
+    {
+        // The table grows a cluster at a time; a chain it cannot record is simply not shared
+        size_t perCluster = Virtual_Disk::getClusterSize() / RECORD_SIZE;
+        if (slot / perCluster >= static_cast<size_t>(chain.getClusterCount()))
+        {
+            vector<Mini_FAT::Extent> added = Mini_FAT::getAvailableClusters() > 0 ? Mini_FAT::allocateClusters(1) : vector<Mini_FAT::Extent>();
+            if (added.empty())
+                return;
+            if (chain.getClusterCount() == 0)
+            {
+                chain.assign(added);
+                Mini_FAT::setDedupTableCluster(added.front().first);
+            }
+            else
+            {
+                Mini_FAT::setClusterPointer(chain.getLastCluster(), added.front().first);
+                chain.append(added);
+            }
+        }
+        records.resize(slot + perCluster);
+        for (size_t i = records.size(); --i > slot;)
+            freeSlots.push_back(i);
+    }
+    records[slot] = { hash, cluster, 1, clusters };
+    byHash.emplace(hash, slot);
+    byCluster[cluster] = slot;
+    count(records[slot], 1);
+    markDirty(slot);
+}
+
+bool Dedup_Table::share(int cluster)
+{
+    auto it = byCluster.find(cluster);
+    if (it == byCluster.end() || records[it->second].references >= MAX_REFERENCES)
+        return false;
+    Record& record = records[it->second];
+    count(record, -1);
+    record.references++;
+    count(record, 1);
+    markDirty(it->second);
+    return true;
+}
+
+bool Dedup_Table::release(int cluster)
+{
+    auto it = byCluster.find(cluster);
+    if (it == byCluster.end())
+        return true;
+    size_t slot = it->second;
+    Record& record = records[slot];
+    count(record, -1);
+    markDirty(slot);
+    if (--record.references > 0)
+    {
+        count(record, 1);
+        return false;
+    }
+
+    // The last reference: the record goes and its slot is free for the next chain
+    auto range = byHash.equal_range(record.hash);
+    for (auto h = range.first; h != range.second; ++h)
+    {
+        if (h->second == slot)
+        {
+            byHash.erase(h);
+            break;
+        }
+    }
+    byCluster.erase(it);
+    record.cluster = 0;
+    freeSlots.push_back(slot);
+    return true;
+}
+
+long long Dedup_Table::getChains()
+{
+    return chains;
+}
+
+long long Dedup_Table::getReferences()
+{
+    return references;
+}
+
+long long Dedup_Table::getSavedClusters()
+{
+    return savedClusters;
+}
+
+void Dedup_Table::count(const Record& record, int sign)
+{
+    chains += sign;
+    references += sign * static_cast<long long>(record.references);
+    savedClusters += sign * static_cast<long long>(record.references - 1) * record.clusters;
+}
+
+void Dedup_Table::markDirty(size_t slot)
+{
+    size_t index = slot / (Virtual_Disk::getClusterSize() / RECORD_SIZE);
+    if (index >= dirtyClusters.size())
+        dirtyClusters.resize(index + 1, false);
+    dirtyClusters[index] = true;
+}
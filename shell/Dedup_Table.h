@@ -0,0 +1,81 @@
+#pragma once
+#include "Extent_Map.h"
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+/** Reference counts of the chains that file frames share on a volume with deduplication, and the content hash
+    that finds a chain again. A frame whose stored bytes hash like a chain in the table, and match it byte for
+    byte, points at that chain instead of a new one; writing the frame later gives it a chain of its own (copy on
+    write), and a chain is freed when its last reference goes.
+
+    The table is a chain of its own, named in the superblock, of 16-byte little-endian records: the hash's low and
+    high halves, the chain's first cluster (0 for a free slot), and the reference count with the chain's length in
+    clusters in its top byte. Records keep their slot, so only the clusters holding changed ones are written back,
+    by sync at the end of each command. */
+class Dedup_Table
+{
+public:
+    /** Most references one chain can have; a frame past that gets a chain of its own. */
+    static const int MAX_REFERENCES = (1 << 24) - 1;
+
+    /** Reads the table of the volume open in Mini_FAT (an empty one without deduplication). */
+    static void load();
+
+    /** Writes the clusters holding changed records, and gives back the clusters at the end that hold none. */
+    static void sync();
+
+    /** 64-bit hash of a frame's stored bytes; fast rather than collision-proof, which find makes up for. */
+    static uint64_t hash(span<const char> data);
+
+    /** First cluster of a chain in the table holding exactly 'data', or -1. */
+    static int find(uint64_t hash, span<const char> data);
+
+    /** Records a chain of 'clusters' clusters just written with 'hash' content, with one reference. A chain the
+        table has no room for (the disk is full) is left out, and stays its writer's own. */
+    static void add(uint64_t hash, int cluster, int clusters);
+
+    /** Adds a reference to the chain at 'cluster'; false when it has as many as it can take. */
+    static bool share(int cluster);
+
+    /** Drops a reference to the chain at 'cluster'. True when none are left, or it was never in the table: the
+        caller then owns the chain, to free or to rewrite. */
+    static bool release(int cluster);
+
+    /** Chains in the table, references to them, and the clusters the references beyond the first would have taken. */
+    static long long getChains();
+    static long long getReferences();
+    static long long getSavedClusters();
+
+private:
+    struct Record
+    {
+        uint64_t hash;
+        int cluster;        // first cluster of the chain, 0 for a free slot
+        int references;
+        int clusters;       // length of the chain
+    };
+
+    static const int RECORD_SIZE = 16;
+
+    /** Adds a record to the totals ('sign' +1) or takes it out of them (-1). */
+    static void count(const Record& record, int sign);
+
+    /** Marks the table cluster holding 'slot' for the next sync. */
+    static void markDirty(size_t slot);
+
+    static vector<Record> records;
+    static vector<size_t> freeSlots;
+    static unordered_multimap<uint64_t, size_t> byHash;
+    static unordered_map<int, size_t> byCluster;
+
+    /** Clusters of the table holding changed records, by index in its chain. */
+    static vector<bool> dirtyClusters;
+    static Extent_Map chain;
+
+    static long long chains;
+    static long long references;
+    static long long savedClusters;
+};
@@ -1,55 +1,72 @@
 #include "Directory.h"
+#include "Directory_Tree.h"
+#include "Mounted_Tree.h"
+#include "Path_Resolver.h"
 #include <algorithm>
 #include <cctype>
 #include <cstring>
-#include <sstream>
 using namespace std;
 
+vector<Directory*> Directory::dirtyDirectories;
+
+static Directory_Record recordOf(const Directory_Entry& entry)
+{
+    Directory_Record record;
+    Converter::Directory_EntryToRecord(entry, record);
+    return record;
+}
+
 Directory::Directory(string name, char dir_attr, int dir_firstCluster, Directory* pa)
     : Directory_Entry(name, dir_attr, dir_firstCluster)  
 {
     this-> parent = pa;
 }
 
+Directory::~Directory()
+{
+    // Cached dentries may lead here
+    flush();
+    Path_Resolver::invalidate();
+}
+
 
 Directory_Entry Directory::GetDirectory_Entry()
 {
-    Directory_Entry M(this->dir_name, this->dir_attr, this->dir_firstCluster);
-    for (int i = 0; i < 12; i++)
-    {
-        M.dir_empty[i] = this->dir_empty[i];
-    }
-    M.dir_fileSize = this->dir_fileSize;
+    // Copy the record as it is: rebuilding it from dir_name would read past the unterminated name
+    Directory_Entry M(*this);
     return M;
 }
 
 int Directory::getmySizeOnDisk()
 {
-    int size = 0;
-    if (dir_firstCluster != 0)
-    {
-        int cluster = dir_firstCluster;
-        int next = Mini_FAT::getClusterPointer(cluster);
-        do
-        {
-            size++;
-            cluster = next;
-            if (cluster != -1)
-                next = Mini_FAT::getClusterPointer(cluster);
-        } while (cluster != -1);
-    }
-    return size;
+    extents.load(dir_firstCluster);
+    return extents.getClusterCount();
 }
 
 bool Directory::canAddEntry(Directory_Entry d)
 {
     bool can = false;
-    int neededSize = (DirOrFiles.size() + 1) * 32;
-    int neededCluster = neededSize / 1024;
-    int rem = neededSize % 1024;
-    if (rem > 0) neededCluster++;
-    neededCluster += d.dir_fileSize / 1024;
-    int rem1 = d.dir_fileSize % 1024;
+    long long clusterSize = Mini_FAT::getClusterSize();
+    long long neededCluster;
+    if (isTree)
+    {
+        // An insert may split a node on every level and the root, on top of the clusters the tree has now
+        neededCluster = getmySizeOnDisk() + Directory_Tree::splitReserve(dir_firstCluster);
+    }
+    else if (Mini_FAT::hasTreeDirectories() && DirOrFiles.size() + 1 > Directory_Tree::getThreshold())
+    {
+        // The entry that crosses the threshold rewrites the directory as a tree
+        neededCluster = static_cast<long long>(Directory_Tree::nodesFor(DirOrFiles.size() + 1));
+    }
+    else
+    {
+        long long neededSize = (DirOrFiles.size() + 1) * 32;
+        neededCluster = neededSize / clusterSize;
+        long long rem = neededSize % clusterSize;
+        if (rem > 0) neededCluster++;
+    }
+    neededCluster += d.dir_fileSize / clusterSize;
+    long long rem1 = d.dir_fileSize % clusterSize;
     if (rem1 > 0) neededCluster++;
     if (getmySizeOnDisk() + Mini_FAT::getAvailableClusters() >= neededCluster)
         can = true;
@@ -58,49 +75,110 @@ bool Directory::canAddEntry(Directory_Entry d)
 
 void Directory::emptymyClusters()
 {
-    if (this->dir_firstCluster != 0)
-    {
-        int cluster = this->dir_firstCluster;
-        int next = Mini_FAT::getClusterPointer(cluster);
-        if (cluster == 5 && next == 0)
-            return;
-        do
-        {
-            Mini_FAT::setClusterPointer(cluster, 0);
-            cluster = next;
-            if (cluster != -1)
-                next = Mini_FAT::getClusterPointer(cluster);
-        } while (cluster != -1);
-    }
+    // An already released chain loads as empty, so nothing is freed twice; slots not yet flushed go with it
+    extents.load(dir_firstCluster);
+    extents.freeAll();
+    dirtyClusters.clear();
 }
 
 void Directory::updatecontent(Directory_Entry OLD, Directory_Entry New)
 {
-    readDirectory();
-    int index = searchDirectory(OLD.dir_name);
+    // The in-memory entries are the current ones; only the on-disk fields of the child change,
+    // so its runtime state (subdirectory pointer, content) survives
+    int index = searchDirectory(OLD.getName());
     if (index != -1)
     {
-        DirOrFiles[index] = New;
-        writeDirectory();
+        Directory_Entry& entry = DirOrFiles[index];
+        // A child whose record did not change leaves the directory untouched
+        Directory_Record before = recordOf(entry);
+        Directory_Record after = recordOf(New);
+        if (memcmp(&before, &after, sizeof(before)) == 0)
+            return;
+        bool renamed = memcmp(OLD.dir_name, New.dir_name, sizeof(OLD.dir_name)) != 0;
+        if (renamed && isTree && !Directory_Tree::canInsert(*this))
+        {
+            cout << "Error: Not enough free space on the disk to grow the directory.\n";
+            return;
+        }
+        if (renamed)
+            unindexEntry(index);
+        memcpy(entry.dir_name, New.dir_name, sizeof(entry.dir_name));
+        entry.dir_attr = New.dir_attr;
+        memcpy(entry.dir_empty, New.dir_empty, sizeof(entry.dir_empty));
+        entry.dir_firstCluster = New.dir_firstCluster;
+        entry.dir_fileSize = New.dir_fileSize;
+        if (renamed)
+            nameIndex.emplace(indexKey(entry), index);
+        // A tree rewrites only the leaf holding the record, a flat directory only the record's slot; either way
+        // the first cluster, and so the parent entry, stay put
+        if (isTree)
+            Directory_Tree::update(*this, OLD, entry);
+        else if (entrySlots[index] != -1)
+            markSlotDirty(entrySlots[index]);
+        else
+            writeDirectory();
     }
 }
 
 void Directory::removeEntry(Directory_Entry d)
 {
-    auto it = find_if(DirOrFiles.begin(), DirOrFiles.end(), [&](const Directory_Entry& entry) {
-        return entry.getName() == d.getName();
-        });
-    if (it != DirOrFiles.end()) {
-        DirOrFiles.erase(it);
-        writeDirectory();
+    int index = searchDirectory(d.getName());
+    if (index != -1) {
+        // Later entries shift down one place and keep their order; their index values follow without re-hashing
+        Directory_Entry removed = DirOrFiles[index];
+        unindexEntry(index);
+        int slot = isTree ? -1 : entrySlots[index];
+        DirOrFiles.erase(DirOrFiles.begin() + index);
+        if (!isTree)
+            entrySlots.erase(entrySlots.begin() + index);
+        for (auto& position : nameIndex)
+        {
+            if (position.second > index)
+                position.second--;
+        }
+        if (removed.dir_attr == 0x10)
+            subDirectories.erase(subDirectoryKey(removed));
+        Path_Resolver::entryChanged(removed);
+        if (isTree)
+        {
+            // Merged-away nodes stay in the chain until a rebuild packs the tree and frees them
+            if (DirOrFiles.size() >= Directory_Tree::getThreshold() / 2 &&
+                !Directory_Tree::needsRebuild(static_cast<size_t>(getmySizeOnDisk()), DirOrFiles.size()))
+                Directory_Tree::erase(*this, removed);
+            else
+                writeDirectory();
+            return;
+        }
+        // Volumes without deleted markers, and a directory left empty, are written whole
+        if (!DirOrFiles.empty() && slot != -1 && Mini_FAT::hasDeletedSlots())
+            releaseSlot(slot);
+        else
+            writeDirectory();
     }
-    
+
 }
 
 void Directory::addEntry(Directory_Entry d)
 {
     DirOrFiles.push_back(d);
-    writeDirectory();
+    nameIndex.emplace(indexKey(DirOrFiles.back()), static_cast<int>(DirOrFiles.size()) - 1);
+    Path_Resolver::entryChanged(d);
+    if (isTree)
+    {
+        Directory_Tree::insert(*this, DirOrFiles.back());
+    }
+    else if (dir_firstCluster == 0 || (Mini_FAT::hasTreeDirectories() && DirOrFiles.size() > Directory_Tree::getThreshold()))
+    {
+        // A first entry gives the directory its first cluster and a large one becomes a tree: both change the layout
+        entrySlots.push_back(-1);
+        writeDirectory();
+    }
+    else
+    {
+        entrySlots.push_back(claimSlot());
+        if (entrySlots.back() == -1)
+            cout << "Error: Not enough free space on the disk to write the directory.\n";
+    }
 }
 
 void Directory::deletDirectory()
@@ -114,37 +192,220 @@ void Directory::deletDirectory()
 
 int Directory::searchDirectory( string name)
 {
-    for (int i = 0; i < DirOrFiles.size(); i++)
+    // The index narrows the search to names equal ignoring case; the exact spelling decides among them
+    int found = -1;
+    auto range = nameIndex.equal_range(indexKey(name));
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if ((found == -1 || it->second < found) && DirOrFiles[it->second].getName() == name) // Case-sensitive comparison
+            found = it->second;
+    }
+    return found;
+}
+
+int Directory::findEntry(const string& name, bool directoriesOnly) const
+{
+    int found = -1;
+    auto range = nameIndex.equal_range(indexKey(name));
+    for (auto it = range.first; it != range.second; ++it)
     {
-        string entryName = DirOrFiles[i].getName();
-        if (entryName == name) // Case-sensitive comparison
-            return i;
+        if ((found == -1 || it->second < found) && (!directoriesOnly || DirOrFiles[it->second].dir_attr == 0x10))
+            found = it->second;
     }
-    return -1;
+    return found;
+}
+
+bool Directory::renameEntry(int index, const string& newName)
+{
+    // A tree moves the record to its new position, which may split nodes; nothing changes unless that fits
+    if (isTree && !Directory_Tree::canInsert(*this))
+    {
+        cout << "Error: Not enough free space on the disk to grow the directory.\n";
+        return false;
+    }
+    Directory_Entry old = DirOrFiles[index];
+    unindexEntry(index);
+    DirOrFiles[index].assignDir_Name(newName);
+    nameIndex.emplace(indexKey(DirOrFiles[index]), index);
+    auto child = subDirectories.find(subDirectoryKey(old));
+    if (child != subDirectories.end())
+    {
+        Directory* loaded = child->second;
+        subDirectories.erase(child);
+        subDirectories[subDirectoryKey(DirOrFiles[index])] = loaded;
+    }
+    Path_Resolver::entryChanged(old);
+    if (isTree)
+        Directory_Tree::update(*this, old, DirOrFiles[index]);
+    else if (entrySlots[index] != -1)
+        markSlotDirty(entrySlots[index]);
+    else
+        writeDirectory();
+    return true;
+}
+
+void Directory::rebuildIndex()
+{
+    nameIndex.clear();
+    nameIndex.reserve(DirOrFiles.size());
+    for (int i = 0; i < static_cast<int>(DirOrFiles.size()); i++)
+        nameIndex.emplace(indexKey(DirOrFiles[i]), i);
+}
+
+void Directory::unindexEntry(int index)
+{
+    auto range = nameIndex.equal_range(indexKey(DirOrFiles[index]));
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (it->second == index)
+        {
+            nameIndex.erase(it);
+            return;
+        }
+    }
+}
+
+string Directory::indexKey(const Directory_Entry& entry)
+{
+    return nameKey(entry.dir_name);
+}
+
+string Directory::nameKey(const char* name)
+{
+    // Same shape as getName(): the 8-byte base and 3-byte extension without their padding, joined by a dot
+    int baseLength = 8;
+    while (baseLength > 0 && name[baseLength - 1] == ' ')
+        baseLength--;
+    int extLength = 3;
+    while (extLength > 0 && name[8 + extLength - 1] == ' ')
+        extLength--;
+
+    string key;
+    key.reserve(static_cast<size_t>(baseLength + extLength + 1));
+    for (int i = 0; i < baseLength; i++)
+        key += static_cast<char>(tolower(static_cast<unsigned char>(name[i])));
+    if (extLength > 0)
+    {
+        key += '.';
+        for (int i = 0; i < extLength; i++)
+            key += static_cast<char>(tolower(static_cast<unsigned char>(name[8 + i])));
+    }
+    return key;
+}
+
+string Directory::indexKey(const string& name)
+{
+    string key = name;
+    for (char& c : key)
+        c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    return key;
+}
+
+
+Directory* Directory::openSubDirectory(int index)
+{
+    // A child not in the side table yet is built from its record on first use
+    const Directory_Entry& entry = DirOrFiles[index];
+    if (entry.dir_attr != 0x10)
+        return nullptr;
+    string key = subDirectoryKey(entry);
+    auto it = subDirectories.find(key);
+    if (it != subDirectories.end())
+    {
+        Mounted_Tree::touch(it->second);
+        return it->second;
+    }
+    Directory* child = Mounted_Tree::createDirectory(entry.getName(), entry.dir_attr, entry.dir_firstCluster, this);
+    subDirectories.emplace(move(key), child);
+    child->readDirectory();
+    return child;
+}
+
+void Directory::attachSubDirectory(Directory* child)
+{
+    subDirectories[subDirectoryKey(*child)] = child;
+}
+
+void Directory::detachSubDirectory(const Directory* child)
+{
+    auto it = subDirectories.find(subDirectoryKey(*child));
+    if (it != subDirectories.end() && it->second == child)
+    {
+        subDirectories.erase(it);
+        return;
+    }
+    for (it = subDirectories.begin(); it != subDirectories.end(); ++it)
+    {
+        if (it->second == child)
+        {
+            subDirectories.erase(it);
+            return;
+        }
+    }
+}
+
+string Directory::subDirectoryKey(const Directory_Entry& entry)
+{
+    return string(entry.dir_name, sizeof(entry.dir_name));
+}
+
+size_t Directory::getMemoryUsage() const
+{
+    // Hash nodes are counted as a key string, its position and two pointers of overhead
+    size_t usage = sizeof(Directory);
+    usage += DirOrFiles.capacity() * sizeof(Directory_Entry);
+    usage += subDirectories.bucket_count() * sizeof(void*);
+    usage += subDirectories.size() * (sizeof(string) + sizeof(Directory*) + 2 * sizeof(void*));
+    usage += nameIndex.bucket_count() * sizeof(void*);
+    usage += nameIndex.size() * (sizeof(string) + sizeof(int) + 2 * sizeof(void*));
+    usage += entrySlots.capacity() * sizeof(int);
+    usage += (freeSlots.size() + dirtyClusters.size()) * (sizeof(int) + 4 * sizeof(void*));
+    usage += fullPath.capacity();
+    return usage;
 }
 
 
 void Directory::readDirectory() {
+    // Changes still waiting for the end of the command are written first, so the disk is current
+    flushAll();
     if (this->dir_firstCluster != 0)
     {
         DirOrFiles.clear();
-        int cluster = this->dir_firstCluster;
-        int next = Mini_FAT::getClusterPointer(cluster);
-        if (cluster == 5 && next == 0)
-            return;
-        vector<char> ls;
-        do
+        entrySlots.clear();
+        freeSlots.clear();
+        slotEnd = 0;
+        dirtyClusters.clear();
+        isTree = false;
+        extents.load(dir_firstCluster);
+        if (extents.getClusterCount() != 0)
         {
-            vector<char> clusterData = Virtual_Disk::readCluster(cluster);
-            ls.insert(ls.end(), clusterData.begin(), clusterData.end());
-            cluster = next;
-            if (cluster != -1)
-                next = Mini_FAT::getClusterPointer(cluster);
-        } while (cluster != -1);
-
-        DirOrFiles = Converter::BytesToDirectory_Entries(ls);
+            vector<char> first(Virtual_Disk::getClusterSize());
+            Virtual_Disk::readCluster(dir_firstCluster, span<char>(first));
+            if (Mini_FAT::hasTreeDirectories() && Directory_Tree::isTreeNode(first))
+            {
+                isTree = true;
+                Directory_Tree::readAll(dir_firstCluster, DirOrFiles);
+            }
+            else
+            {
+                // Size the buffer once from the chain, then read every run of it straight into place
+                vector<int> chain = extents.getClusters();
+                vector<char> ls(chain.size() * Virtual_Disk::getClusterSize());
+                Virtual_Disk::readClusters(chain, ls);
+                slotEnd = static_cast<int>(Converter::decodeDirectory(ls, DirOrFiles, &entrySlots));
+                // Every slot before the end marker that holds no entry is a deleted one
+                vector<bool> used(static_cast<size_t>(slotEnd));
+                for (int slot : entrySlots)
+                    used[static_cast<size_t>(slot)] = true;
+                for (int slot = 0; slot < slotEnd; slot++)
+                {
+                    if (!used[static_cast<size_t>(slot)])
+                        freeSlots.insert(slot);
+                }
+            }
+        }
     }
-
+    rebuildIndex();
 }
 
 void Directory::writeDirectory()
@@ -152,52 +413,195 @@ void Directory::writeDirectory()
     Directory_Entry A = this->GetDirectory_Entry();
     if (!this->DirOrFiles.empty())
     {
-        vector<char> dirsOrFilesBytes = Converter::Directory_EntriesToBytes(this->DirOrFiles);
-        vector<vector<char>> bytesList = Converter::splitBytes(dirsOrFilesBytes);
-        int clusterFATIndex;
-        if (this->dir_firstCluster != 0)
+        // Large directories become trees; a tree stays one until it shrinks to half the threshold
+        size_t threshold = Directory_Tree::getThreshold();
+        bool asTree = Mini_FAT::hasTreeDirectories() &&
+            (DirOrFiles.size() > threshold || (isTree && DirOrFiles.size() >= threshold / 2));
+        size_t clusterSize = Virtual_Disk::getClusterSize();
+        size_t clusterCount = asTree ? Directory_Tree::nodesFor(DirOrFiles.size())
+            : (DirOrFiles.size() * sizeof(Directory_Record) + clusterSize - 1) / clusterSize;
+        if (clusterCount > static_cast<size_t>(this->getmySizeOnDisk() + Mini_FAT::getAvailableClusters()))
         {
+            cout << "Error: Not enough free space on the disk to write the directory.\n";
+            return;
+        }
+        if (this->dir_firstCluster != 0)
             this->emptymyClusters();
-            clusterFATIndex = Mini_FAT::getAvailableCluster();
-            this->dir_firstCluster = clusterFATIndex;
+        if (asTree)
+        {
+            extents.assign(Directory_Tree::build(this->DirOrFiles));
         }
         else
         {
-            clusterFATIndex = Mini_FAT::getAvailableCluster();
-            if (clusterFATIndex != 0)
-                this->dir_firstCluster = clusterFATIndex;
+            // Allocate the whole chain at once, encode the records straight into whole clusters and write them in one call
+            extents.assign(Mini_FAT::allocateClusters(static_cast<int>(clusterCount)));
+            vector<char> bytes(clusterCount * clusterSize);
+            Converter::encodeDirectory(this->DirOrFiles, bytes);
+            Virtual_Disk::writeClusters(extents.getClusters(), bytes);
         }
-        int lastCluster = -1;
-        for (int i = 0; i < bytesList.size(); i++)
+        // A rewrite packs the records into the first slots with no deleted ones between them
+        entrySlots.clear();
+        freeSlots.clear();
+        slotEnd = 0;
+        dirtyClusters.clear();
+        if (!asTree)
         {
-            if (clusterFATIndex != -1)
-            {
-                Virtual_Disk::writeCluster(bytesList[i], clusterFATIndex);
-                Mini_FAT::setClusterPointer(clusterFATIndex, -1);
-                if (lastCluster != -1)
-                    Mini_FAT::setClusterPointer(lastCluster, clusterFATIndex);
-                lastCluster = clusterFATIndex;
-                clusterFATIndex = Mini_FAT::getAvailableCluster();
-            }
+            slotEnd = static_cast<int>(DirOrFiles.size());
+            entrySlots.resize(DirOrFiles.size());
+            for (int i = 0; i < slotEnd; i++)
+                entrySlots[static_cast<size_t>(i)] = i;
         }
+        isTree = asTree;
+        this->dir_firstCluster = extents.getExtents().front().first;
     }
     if (this->DirOrFiles.empty())
     {
         if (dir_firstCluster != 0)
             this->emptymyClusters();
-        if (parent != nullptr)
-            this->dir_firstCluster = 0;
+        this->dir_firstCluster = 0;
+        isTree = false;
+        entrySlots.clear();
+        freeSlots.clear();
+        slotEnd = 0;
+        dirtyClusters.clear();
     }
     Directory_Entry B = this->GetDirectory_Entry();
     if (this->parent != nullptr)
     {
         this->parent->updatecontent(A, B);
     }
+    else
+    {
+        // The root has no parent entry: the superblock remembers where it lives
+        Mini_FAT::setRootCluster(this->dir_firstCluster);
+    }
+}
+
+int Directory::allocateCluster()
+{
+    extents.load(dir_firstCluster);
+    int last = extents.getLastCluster();
+    vector<Mini_FAT::Extent> extent = Mini_FAT::allocateClusters(1);
+    if (extent.empty())
+        return -1;
+    Mini_FAT::setClusterPointer(last, extent.front().first);
+    extents.append(extent);
+    return extent.front().first;
+}
+
+int Directory::claimSlot()
+{
+    if (!freeSlots.empty())
+    {
+        int slot = *freeSlots.begin();
+        freeSlots.erase(freeSlots.begin());
+        markSlotDirty(slot);
+        return slot;
+    }
+
+    // Every slot is taken when the end marker has reached the end of the chain: it grows by one cluster,
+    // which the flush fills with the record and zeroes after it
+    int slot = slotEnd;
+    int perCluster = static_cast<int>(Virtual_Disk::getClusterSize() / sizeof(Directory_Record));
+    extents.load(dir_firstCluster);
+    if (slot / perCluster >= extents.getClusterCount() && allocateCluster() == -1)
+        return -1;
+    slotEnd++;
+    markSlotDirty(slot);
+    return slot;
+}
+
+void Directory::releaseSlot(int slot)
+{
+    if (slot != slotEnd - 1)
+    {
+        freeSlots.insert(slot);
+        markSlotDirty(slot);
+        return;
+    }
+
+    // The last slot went: the end marker moves back over it and over the deleted slots right before it
+    int end = slot;
+    while (!freeSlots.empty() && *freeSlots.rbegin() == end - 1)
+    {
+        freeSlots.erase(prev(freeSlots.end()));
+        end--;
+    }
+    int perCluster = static_cast<int>(Virtual_Disk::getClusterSize() / sizeof(Directory_Record));
+    extents.load(dir_firstCluster);
+    int keep = max(1, (end + perCluster - 1) / perCluster);
+    extents.truncate(keep);
+    dirtyClusters.erase(dirtyClusters.lower_bound(keep), dirtyClusters.end());
 
-    Mini_FAT::writeFAT();
+    // The kept clusters that held released slots are rewritten, so nothing reappears after the marker
+    int last = min(slotEnd, keep * perCluster);
+    slotEnd = end;
+    for (int from = end; from < last; from += perCluster - from % perCluster)
+        markSlotDirty(from);
+}
+
+void Directory::markSlotDirty(int slot)
+{
+    if (dirtyClusters.empty())
+        dirtyDirectories.push_back(this);
+    dirtyClusters.insert(slot / static_cast<int>(Virtual_Disk::getClusterSize() / sizeof(Directory_Record)));
+}
+
+void Directory::flush()
+{
+    if (!dirtyClusters.empty() && !isTree)
+    {
+        // Each dirty cluster is encoded whole from memory: entries in their slots, deleted markers in the free
+        // ones and zeros after the end marker, so nothing has to be read back first
+        size_t perCluster = Virtual_Disk::getClusterSize() / sizeof(Directory_Record);
+        vector<int> owner(static_cast<size_t>(slotEnd), -1);
+        for (size_t i = 0; i < entrySlots.size(); i++)
+        {
+            if (entrySlots[i] != -1)
+                owner[static_cast<size_t>(entrySlots[i])] = static_cast<int>(i);
+        }
+        extents.load(dir_firstCluster);
+        vector<char> bytes(Virtual_Disk::getClusterSize());
+        for (int index : dirtyClusters)
+        {
+            fill(bytes.begin(), bytes.end(), 0);
+            Directory_Record* records = reinterpret_cast<Directory_Record*>(bytes.data());
+            size_t first = static_cast<size_t>(index) * perCluster;
+            for (size_t slot = first; slot < first + perCluster && slot < owner.size(); slot++)
+            {
+                if (owner[slot] != -1)
+                    Converter::Directory_EntryToRecord(DirOrFiles[static_cast<size_t>(owner[slot])], records[slot - first]);
+                else
+                    records[slot - first].name[0] = static_cast<char>(DELETED_RECORD);
+            }
+            Virtual_Disk::writeCluster(span<const char>(bytes), extents.getClusterAt(index));
+        }
+    }
+    dirtyClusters.clear();
+    dirtyDirectories.erase(remove(dirtyDirectories.begin(), dirtyDirectories.end(), this), dirtyDirectories.end());
+}
+
+void Directory::flushAll()
+{
+    // Flushing never dirties another directory, so one pass empties the list
+    vector<Directory*> pending;
+    pending.swap(dirtyDirectories);
+    for (Directory* dir : pending)
+        dir->flush();
 }
 
 string Directory::getFullPath() const
+{
+    // The prompt asks for it before every command: it is built once and kept until a directory changes
+    if (fullPathGeneration != Path_Resolver::getGeneration())
+    {
+        fullPath = buildFullPath();
+        fullPathGeneration = Path_Resolver::getGeneration();
+    }
+    return fullPath;
+}
+
+string Directory::buildFullPath() const
 {
     if (parent == nullptr)
     {
@@ -245,66 +649,10 @@ Directory_Entry Directory::findSubDirectory(const string& dirname)
 
 Directory* Directory::getDirectoryByPath(const string& path)
 {
+    // Subdirectories come from the shared tree of loaded directories, so nothing is allocated per call
     if (path.empty())
-    {
         return this;
-    }
-
-    vector<string> pathComponents;
-    string component;
-    stringstream ss (path);
-    while (getline(ss, component, '/'))
-    {
-        if (!component.empty())
-            pathComponents.push_back(component);
-    }
-
-    Directory* traversalDir = this;
-
-    for (const auto& dirName : pathComponents)
-    {
-        if (dirName == ".")
-        {
-            // Current directory: do nothing
-            continue;
-        }
-        else if (dirName == "..")
-        {
-            // Parent directory
-            if (traversalDir->parent != nullptr)
-            {
-                traversalDir = traversalDir->parent;
-            }
-            else
-            {
-                // Reached root; cannot go up further
-                return nullptr;
-            }
-        }
-        else
-        {
-            // Subdirectory
-            int dirIndex = traversalDir->searchDirectory(dirName);
-            if (dirIndex == -1)
-            {
-                // Subdirectory not found
-                return nullptr;
-            }
-
-            Directory_Entry subDirEntry = traversalDir->DirOrFiles[dirIndex];
-            if (subDirEntry.dir_attr != 0x10)
-            {
-                // Not a directory
-                return nullptr;
-            }
-
-            // Load the subdirectory
-            traversalDir = new Directory(subDirEntry.getName(), subDirEntry.dir_attr, subDirEntry.dir_firstCluster, traversalDir);
-            traversalDir->readDirectory();
-        }
-    }
-
-    return traversalDir;
+    return Path_Resolver::resolve(this, path).directory;
 }
 string Directory::getDrive() const
 {
@@ -1,7 +1,10 @@
 #pragma once
+#include<set>
+#include<unordered_map>
 #include<vector>
 #include"Directory_Entry.h"
 #include "Mini_FAT.h"
+#include "Extent_Map.h"
 #include "Virtual_Disk.h"
 #include "Converter.h"
 using namespace std;
@@ -13,10 +16,26 @@ class Directory : public Directory_Entry {
 
 		Directory* parent;
 
-        Directory_Entry dir_entry;
+		/** The directory's clusters, loaded from the FAT on first use. */
+		Extent_Map extents;
+
+		/** Whether the directory is stored as a B+tree (see Directory_Tree) rather than a flat array of records. */
+		bool isTree = false;
+
+		/** Slot of each entry of a flat directory, in step with DirOrFiles (-1 for an entry that never reached the disk). */
+		vector<int> entrySlots;
+
+		/** Deleted slots of a flat directory, reused lowest first, and the number of slots before its end marker. */
+		set<int> freeSlots;
+		int slotEnd = 0;
+
+		/** Positions in the chain of the clusters of a flat directory whose slots changed since the last flush. */
+		set<int> dirtyClusters;
 
         Directory(string name, char dir_attr, int dir_firstCluster, Directory* pa);
 
+		~Directory();
+
 		Directory_Entry GetDirectory_Entry();
 
 		int getmySizeOnDisk();
@@ -27,6 +46,30 @@ class Directory : public Directory_Entry {
 
 		void writeDirectory();
 
+		/** Takes a free cluster and links it at the end of the directory's chain; -1 if the disk is full. */
+		int allocateCluster();
+
+		/** Finds a slot for a new entry of a flat directory: a deleted one or the one after the last, growing the chain
+		    by a cluster only when every slot is taken. Returns the slot, or -1 when the disk is full. */
+		int claimSlot();
+
+		/** Marks a slot of a flat directory deleted; a slot at the end moves the end marker back instead, and clusters
+		    left holding no slots are released. */
+		void releaseSlot(int slot);
+
+		/** Records that a slot changed; its cluster is written at the next flush. */
+		void markSlotDirty(int slot);
+
+		/** Writes each changed cluster of the directory once, straight from the entries in memory. */
+		void flush();
+
+		/** Flushes every directory with changed slots. Called at the sync points: the end of each shell command,
+		    before unmount, and before any directory is read back from disk. */
+		static void flushAll();
+
+		/** Directories with clusters waiting for a flush. */
+		static vector<Directory*> dirtyDirectories;
+
 		void readDirectory ();
 
 		void addEntry(Directory_Entry d);
@@ -39,10 +82,60 @@ class Directory : public Directory_Entry {
 
 		int searchDirectory(string name);
 
+		/** Returns the index of the first entry named 'name' ignoring case (only directories when asked), or -1. */
+		int findEntry(const string& name, bool directoriesOnly = false) const;
+
+		/** Renames the entry at 'index' and writes the directory, keeping the name index in step. Returns false, with
+		    nothing changed, when a tree directory has no room to move the record. */
+		bool renameEntry(int index, const string& newName);
+
+		/** Entry positions by case-folded name. Rebuilt when the directory is read, then kept in step one key at a
+		    time by addEntry, removeEntry, renameEntry and updatecontent. */
+		unordered_multimap<string, int> nameIndex;
+
+		/** Re-indexes every entry. */
+		void rebuildIndex();
+
+		/** Drops the index key of the entry at 'index' (call it before the entry's name changes). */
+		void unindexEntry(int index);
+
+		/** Case-folded "name.ext" of an entry, built straight from its 11 name bytes. */
+		static string indexKey(const Directory_Entry& entry);
+		static string nameKey(const char* name);
+
+		/** Case-folded form of a name typed by the user. */
+		static string indexKey(const string& name);
+
+		/** Returns the directory behind the entry at 'index', loading it into the mounted tree the first time it is
+		    opened (or the first time after it was evicted). */
+		Directory* openSubDirectory(int index);
+
+		/** Loaded subdirectories by the 11 name bytes of their entry. Entries stay plain records; this side table holds
+		    the one piece of runtime state they used to carry. */
+		unordered_map<string, Directory*> subDirectories;
+
+		/** Records 'child' as the loaded directory behind its entry here, or forgets it. */
+		void attachSubDirectory(Directory* child);
+		void detachSubDirectory(const Directory* child);
+
+		static string subDirectoryKey(const Directory_Entry& entry);
+
+		/** Bytes this node takes with its entries, name index and slot bookkeeping (an estimate of the heap use). */
+		size_t getMemoryUsage() const;
+
+		/** Tick of the last use, for Mounted_Tree's eviction order. */
+		long long lastUsed = 0;
+
         string getFullPath() const ;
 
-        string name;
+        /** getFullPath's cached result and the resolver generation it was built under. */
+        mutable string fullPath;
+        mutable long long fullPathGeneration = -1;
+
+        string buildFullPath() const;
+
         Directory_Entry findSubDirectory(const string& dirname);
+        /** Resolves 'path' from this directory (see Path_Resolver); nullptr if it leads nowhere. */
         Directory* getDirectoryByPath(const string& path);
 
 		string getDrive() const;
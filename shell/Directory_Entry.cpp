@@ -6,7 +6,7 @@
 
 using namespace std; // Using std namespace for convenience
 Directory_Entry::Directory_Entry()
-    : dir_attr(0x00), dir_firstCluster(0), dir_fileSize(0), subDirectory(nullptr)
+    : dir_attr(0x00), dir_firstCluster(0), dir_fileSize(0)
 {
     // Initialize with empty name
     fill(begin(dir_name), end(dir_name), ' ');
@@ -15,7 +15,7 @@ Directory_Entry::Directory_Entry()
 
 // Constructor to initialize a Directory_Entry object
 Directory_Entry::Directory_Entry(string name, char attr, int firstCluster)
-    : dir_attr(attr), dir_firstCluster(firstCluster), dir_fileSize(0), subDirectory(nullptr)
+    : dir_attr(attr), dir_firstCluster(firstCluster), dir_fileSize(0)
 {
     // Assign name based on attribute
     if (attr == 0x10) // Directory
@@ -132,24 +132,21 @@ std::string Directory_Entry::getName() const
 }
 
 bool Directory_Entry::getIsFile() const {
-    return isFile;
+    return dir_attr != 0x10;
 }
 
-void Directory_Entry::setIsFile(bool isFileFlag) {
-    isFile = isFileFlag;
-}
 
-string Directory_Entry::getContent() const {
-    return content;
+long long Directory_Entry::getSize() const
+{
+    return dir_fileSize;
 }
 
-void Directory_Entry::setContent(const string& newContent) {
-    content = newContent;
-    dir_fileSize = static_cast<int>(newContent.size()); // Update file size
+bool Directory_Entry::isFramed() const
+{
+    return dir_empty[0] == FRAMED_MARK;
 }
 
-
-int Directory_Entry::getSize() const
+void Directory_Entry::setFramed(bool framed)
 {
-    return dir_fileSize;
+    dir_empty[0] = framed ? FRAMED_MARK : ' ';
 }
@@ -3,8 +3,9 @@
 #include <string>
 using namespace std;
 
-class Directory;
-
+/** A directory entry as held in Directory::DirOrFiles: the fields of the 32-byte on-disk record and nothing else,
+    so a directory's entries form one flat array that listings and lookups scan without chasing pointers.
+    Runtime state lives beside it: loaded subdirectories in their parent's side table, file content in File_Entry. */
 class Directory_Entry
 {
 public:
@@ -14,18 +15,22 @@ public:
     void assignDir_Name(string name);
     char dir_name[11];
     char dir_attr;
-    char dir_empty[12];
+    char dir_empty[8];          // reserved bytes 12-19 of the record; the first marks a framed file
     int dir_firstCluster;
-    int dir_fileSize;
-    Directory* subDirectory;
+    long long dir_fileSize;
     static string cleanTheName(string s);
     string getName() const;
     bool getIsFile() const;
-    void setIsFile(bool isFile);
-    string getContent() const;
-    void setContent(const string& content);
-    bool isFile;
-    string content;
-    int getSize() const;
+    long long getSize() const;
+
+    /** Whether the file's data is stored in frames found through an index (see File_Handle), as on volumes with
+        compression or deduplication; its size stays the logical one. */
+    bool isFramed() const;
+    void setFramed(bool framed);
+
+    /** Value of the first reserved byte for a framed file; anything else (blank on older volumes) means plain. */
+    static const char FRAMED_MARK = 'Z';
 
 };
+
+static_assert(sizeof(Directory_Entry) == 32, "an entry in memory is as small as its on-disk record");
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/** The 32-byte on-disk form of a directory entry. Integers are little-endian. On volumes with large files the last
+    four reserved bytes carry the high half of the size; elsewhere they are reserved like the rest. The first reserved
+    byte marks a framed file (Directory_Entry::FRAMED_MARK). A record whose
+    first name byte is 0 is a free slot and ends the directory; one starting with DELETED_RECORD was removed and its
+    slot may be reused, but later records still count. */
+#pragma pack(push, 1)
+struct Directory_Record
+{
+    char name[11];
+    char attr;
+    char reserved[8];
+    uint32_t sizeHigh;
+    uint32_t firstCluster;
+    uint32_t size;
+};
+#pragma pack(pop)
+
+/** First name byte of a removed record (the FAT convention). */
+constexpr unsigned char DELETED_RECORD = 0xE5;
+
+static_assert(sizeof(Directory_Record) == 32, "directory records are 32 bytes on disk");
+static_assert(alignof(Directory_Record) == 1, "records are read in place from any byte of a cluster buffer");
+static_assert(offsetof(Directory_Record, attr) == 11, "attribute byte follows the 11-byte name");
+static_assert(offsetof(Directory_Record, sizeHigh) == 20, "high half of the size sits in the reserved bytes");
+static_assert(offsetof(Directory_Record, firstCluster) == 24, "first cluster at byte 24");
+static_assert(offsetof(Directory_Record, size) == 28, "size at byte 28");
@@ -0,0 +1,486 @@
+#include "Directory_Tree.h"
+#include "Converter.h"
+#include "Directory.h"
+#include "Mini_FAT.h"
+#include "Virtual_Disk.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+// Node layout: a 32-byte header, then records (leaves) or 16-byte key/child slots (internal nodes).
+// Header: a zero byte and the "BTREE" tag, the kind, the entry or key count, then the next leaf
+// (leaves) or the first child (internal nodes).
+static const char NODE_TAG[6] = { 0, 'B', 'T', 'R', 'E', 'E' };
+static const char LEAF_NODE = 1;
+static const char INTERNAL_NODE = 2;
+static const size_t KIND_OFFSET = 6;
+static const size_t COUNT_OFFSET = 8;
+static const size_t LINK_OFFSET = 12;
+static const size_t HEADER_SIZE = 32;
+static const size_t KEY_SIZE = 12;
+static const size_t SLOT_SIZE = 16;
+
+struct Directory_Tree::Node
+{
+    int cluster = 0;
+    bool leaf = true;
+    int next = 0;                      // next leaf to the right (leaves only), 0 for the last one
+    vector<Directory_Record> records;  // leaves: sorted by key
+    vector<string> keys;               // internal: children[i + 1] holds the keys >= keys[i]
+    vector<int> children;
+};
+
+static int getInt(const char* bytes)
+{
+    int value;
+    memcpy(&value, bytes, 4);
+    Converter::fromLittleEndian(span<int>(&value, 1));
+    return value;
+}
+
+static void putInt(char* bytes, int value)
+{
+    Converter::intsToLittleEndian(span<char>(bytes, 4), span<const int>(&value, 1));
+}
+
+// Position of the first key greater than 'key' ('upper') or not less than it
+static size_t keyPosition(const vector<string>& keys, const string& key, bool upper)
+{
+    auto it = upper ? upper_bound(keys.begin(), keys.end(), key) : lower_bound(keys.begin(), keys.end(), key);
+    return static_cast<size_t>(it - keys.begin());
+}
+
+bool Directory_Tree::isTreeNode(span<const char> cluster)
+{
+    return cluster.size() >= HEADER_SIZE && equal(begin(NODE_TAG), end(NODE_TAG), cluster.begin());
+}
+
+size_t Directory_Tree::getThreshold()
+{
+    return 4 * (static_cast<size_t>(Mini_FAT::getClusterSize()) / sizeof(Directory_Record));
+}
+
+size_t Directory_Tree::leafCapacity()
+{
+    return (static_cast<size_t>(Mini_FAT::getClusterSize()) - HEADER_SIZE) / sizeof(Directory_Record);
+}
+
+size_t Directory_Tree::internalCapacity()
+{
+    return (static_cast<size_t>(Mini_FAT::getClusterSize()) - HEADER_SIZE) / SLOT_SIZE;
+}
+
+size_t Directory_Tree::nodesFor(size_t entries)
+{
+    size_t level = max<size_t>(1, (entries + leafCapacity() - 1) / leafCapacity());
+    size_t total = level;
+    while (level > 1)
+    {
+        level = (level + internalCapacity()) / (internalCapacity() + 1);
+        total += level;
+    }
+    return total;
+}
+
+int Directory_Tree::splitReserve(int root)
+{
+    int levels = 0;
+    Node node = readNode(root);
+    while (!node.leaf)
+    {
+        levels++;
+        node = readNode(node.children.front());
+    }
+    return levels + 2;
+}
+
+bool Directory_Tree::canInsert(const Directory& dir)
+{
+    return Mini_FAT::getAvailableClusters() >= splitReserve(dir.dir_firstCluster);
+}
+
+bool Directory_Tree::needsRebuild(size_t clusters, size_t entries)
+{
+    // Leaves grown by splits are at least half full, so a chain four times the packed size comes from deletes,
+    // and after a rebuild it takes about as many deletes again to get there
+    return clusters > 4 * nodesFor(entries);
+}
+
+string Directory_Tree::recordKey(const Directory_Record& record)
+{
+    return Directory::nameKey(record.name);
+}
+
+vector<Mini_FAT::Extent> Directory_Tree::build(const vector<Directory_Entry>& entries)
+{
+    // Records sorted by key; equal keys keep their directory order
+    vector<pair<string, Directory_Record>> sorted(entries.size());
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        sorted[i].first = Directory::indexKey(entries[i]);
+        Converter::Directory_EntryToRecord(entries[i], sorted[i].second);
+    }
+    stable_sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    vector<Mini_FAT::Extent> extents = Mini_FAT::allocateClusters(static_cast<int>(nodesFor(entries.size())));
+    if (extents.empty())
+        return extents;
+    vector<int> clusters = Mini_FAT::getExtentClusters(extents);
+
+    // Levels are laid out from the root down so the root lands in the first cluster of the chain
+    size_t leafCap = leafCapacity();
+    size_t fanout = internalCapacity() + 1;
+    vector<size_t> levelSizes(1, max<size_t>(1, (sorted.size() + leafCap - 1) / leafCap));
+    while (levelSizes.back() > 1)
+        levelSizes.push_back((levelSizes.back() + fanout - 1) / fanout);
+    vector<size_t> levelStart(levelSizes.size());
+    size_t next = 0;
+    for (size_t level = levelSizes.size(); level-- > 0;)
+    {
+        levelStart[level] = next;
+        next += levelSizes[level];
+    }
+
+    size_t clusterSize = static_cast<size_t>(Mini_FAT::getClusterSize());
+    vector<char> bytes(clusters.size() * clusterSize);
+
+    // Leaves, each remembering its first key for the level above
+    vector<string> firstKeys;
+    for (size_t i = 0; i < levelSizes[0]; i++)
+    {
+        Node leaf;
+        leaf.cluster = clusters[levelStart[0] + i];
+        leaf.next = i + 1 < levelSizes[0] ? clusters[levelStart[0] + i + 1] : 0;
+        size_t from = i * leafCap;
+        size_t to = min(sorted.size(), from + leafCap);
+        for (size_t r = from; r < to; r++)
+            leaf.records.push_back(sorted[r].second);
+        firstKeys.push_back(from < to ? sorted[from].first : string());
+        encodeNode(leaf, span<char>(bytes).subspan((levelStart[0] + i) * clusterSize, clusterSize));
+    }
+
+    for (size_t level = 1; level < levelSizes.size(); level++)
+    {
+        vector<string> levelKeys;
+        for (size_t i = 0; i < levelSizes[level]; i++)
+        {
+            Node node;
+            node.leaf = false;
+            node.cluster = clusters[levelStart[level] + i];
+            size_t from = i * fanout;
+            size_t to = min(levelSizes[level - 1], from + fanout);
+            for (size_t c = from; c < to; c++)
+            {
+                if (c > from)
+                    node.keys.push_back(firstKeys[c]);
+                node.children.push_back(clusters[levelStart[level - 1] + c]);
+            }
+            levelKeys.push_back(firstKeys[from]);
+            encodeNode(node, span<char>(bytes).subspan((levelStart[level] + i) * clusterSize, clusterSize));
+        }
+        firstKeys.swap(levelKeys);
+    }
+
+    Virtual_Disk::writeClusters(clusters, bytes);
+    return extents;
+}
+
+void Directory_Tree::readAll(int root, vector<Directory_Entry>& out)
+{
+    Node node = readNode(root);
+    while (!node.leaf)
+        node = readNode(node.children.front());
+    while (true)
+    {
+        for (const Directory_Record& record : node.records)
+            Converter::RecordToDirectory_Entry(record, out.emplace_back());
+        if (node.next == 0)
+            break;
+        node = readNode(node.next);
+    }
+}
+
+bool Directory_Tree::insert(Directory& dir, const Directory_Entry& entry)
+{
+    int root = dir.dir_firstCluster;
+    string key = Directory::indexKey(entry);
+
+    // Walk down to the leaf, remembering the path and the child taken at each level
+    vector<Node> path;
+    vector<size_t> taken;
+    Node node = readNode(root);
+    while (!node.leaf)
+    {
+        size_t child = keyPosition(node.keys, key, true);
+        int childCluster = node.children[child];
+        path.push_back(move(node));
+        taken.push_back(child);
+        node = readNode(childCluster);
+    }
+
+    // Every level may split, and splitting the root takes two clusters
+    if (Mini_FAT::getAvailableClusters() < static_cast<int>(path.size()) + 2)
+    {
+        cout << "Error: Not enough free space on the disk to grow the directory.\n";
+        return false;
+    }
+
+    Directory_Record record;
+    Converter::Directory_EntryToRecord(entry, record);
+    size_t slot = 0;
+    while (slot < node.records.size() && recordKey(node.records[slot]) <= key)
+        slot++;
+    node.records.insert(node.records.begin() + static_cast<ptrdiff_t>(slot), record);
+    if (node.records.size() <= leafCapacity())
+    {
+        writeNode(node);
+        return true;
+    }
+
+    // Split the leaf; a root leaf moves into two new leaves and becomes their parent
+    size_t half = node.records.size() / 2;
+    Node right;
+    right.records.assign(node.records.begin() + static_cast<ptrdiff_t>(half), node.records.end());
+    node.records.resize(half);
+    string separator = recordKey(right.records.front());
+    if (path.empty())
+    {
+        Node left;
+        left.cluster = dir.allocateCluster();
+        right.cluster = dir.allocateCluster();
+        left.records.swap(node.records);
+        left.next = right.cluster;
+        right.next = 0;
+        node.leaf = false;
+        node.next = 0;
+        node.keys = { separator };
+        node.children = { left.cluster, right.cluster };
+        writeNode(left);
+        writeNode(right);
+        writeNode(node);
+        return true;
+    }
+    right.cluster = dir.allocateCluster();
+    right.next = node.next;
+    node.next = right.cluster;
+    writeNode(node);
+    writeNode(right);
+    int newChild = right.cluster;
+
+    // Hand the separator up until a parent has room for it
+    for (size_t level = path.size(); level-- > 0;)
+    {
+        Node& parent = path[level];
+        parent.keys.insert(parent.keys.begin() + static_cast<ptrdiff_t>(taken[level]), separator);
+        parent.children.insert(parent.children.begin() + static_cast<ptrdiff_t>(taken[level]) + 1, newChild);
+        if (parent.keys.size() <= internalCapacity())
+        {
+            writeNode(parent);
+            return true;
+        }
+
+        size_t middle = parent.keys.size() / 2;
+        string up = parent.keys[middle];
+        Node upper;
+        upper.leaf = false;
+        upper.keys.assign(parent.keys.begin() + static_cast<ptrdiff_t>(middle) + 1, parent.keys.end());
+        upper.children.assign(parent.children.begin() + static_cast<ptrdiff_t>(middle) + 1, parent.children.end());
+        parent.keys.resize(middle);
+        parent.children.resize(middle + 1);
+        if (level == 0)
+        {
+            Node lower;
+            lower.leaf = false;
+            lower.cluster = dir.allocateCluster();
+            upper.cluster = dir.allocateCluster();
+            lower.keys.swap(parent.keys);
+            lower.children.swap(parent.children);
+            parent.keys = { up };
+            parent.children = { lower.cluster, upper.cluster };
+            writeNode(lower);
+            writeNode(upper);
+            writeNode(parent);
+            return true;
+        }
+        upper.cluster = dir.allocateCluster();
+        writeNode(parent);
+        writeNode(upper);
+        separator = up;
+        newChild = upper.cluster;
+    }
+    return true;
+}
+
+bool Directory_Tree::erase(Directory& dir, const Directory_Entry& entry)
+{
+    int root = dir.dir_firstCluster;
+    string key = Directory::indexKey(entry);
+
+    // Walk down to the leftmost leaf that may hold the key, remembering the parent and the child taken there
+    Node parent;
+    size_t taken = 0;
+    bool hasParent = false;
+    Node leaf = readNode(root);
+    while (!leaf.leaf)
+    {
+        taken = keyPosition(leaf.keys, key, false);
+        int childCluster = leaf.children[taken];
+        parent = move(leaf);
+        hasParent = true;
+        leaf = readNode(childCluster);
+    }
+    int descended = leaf.cluster;
+    size_t slot;
+    if (!scanRecord(entry, key, leaf, slot))
+        return false;
+    leaf.records.erase(leaf.records.begin() + static_cast<ptrdiff_t>(slot));
+
+    // Equal keys straddling a split put the record right of the leaf the walk reached; that leaf is only written
+    if (!hasParent || leaf.cluster != descended || leaf.records.size() > leafCapacity() / 4 || parent.children.size() < 2)
+    {
+        writeNode(leaf);
+        return true;
+    }
+
+    // Merge with the right sibling, or the left one for the last child, when both fit in one node
+    size_t leftChild = taken + 1 < parent.children.size() ? taken : taken - 1;
+    Node left = leftChild == taken ? move(leaf) : readNode(parent.children[leftChild]);
+    Node right = leftChild == taken ? readNode(parent.children[taken + 1]) : move(leaf);
+    if (left.records.size() + right.records.size() > leafCapacity())
+    {
+        writeNode(leftChild == taken ? left : right);
+        return true;
+    }
+    left.records.insert(left.records.end(), right.records.begin(), right.records.end());
+    left.next = right.next;
+    parent.keys.erase(parent.keys.begin() + static_cast<ptrdiff_t>(leftChild));
+    parent.children.erase(parent.children.begin() + static_cast<ptrdiff_t>(leftChild) + 1);
+
+    // A root left with a single leaf takes the leaf's records itself
+    if (parent.cluster == root && parent.children.size() == 1)
+    {
+        left.cluster = root;
+        left.next = 0;
+        writeNode(left);
+        return true;
+    }
+    writeNode(left);
+    writeNode(parent);
+    return true;
+}
+
+bool Directory_Tree::update(Directory& dir, const Directory_Entry& old, const Directory_Entry& updated)
+{
+    // A new name means a new position in the tree; room for the insert is made sure of before the erase
+    if (memcmp(old.dir_name, updated.dir_name, sizeof(old.dir_name)) != 0)
+    {
+        if (!canInsert(dir))
+        {
+            cout << "Error: Not enough free space on the disk to grow the directory.\n";
+            return false;
+        }
+        return erase(dir, old) && insert(dir, updated);
+    }
+
+    Node leaf;
+    size_t slot;
+    if (!findRecord(dir.dir_firstCluster, old, leaf, slot))
+        return false;
+    Converter::Directory_EntryToRecord(updated, leaf.records[slot]);
+    writeNode(leaf);
+    return true;
+}
+
+bool Directory_Tree::findRecord(int root, const Directory_Entry& entry, Node& leaf, size_t& slot)
+{
+    // Equal keys may straddle a split, so descend left of them and scan right
+    string key = Directory::indexKey(entry);
+    leaf = readNode(root);
+    while (!leaf.leaf)
+        leaf = readNode(leaf.children[keyPosition(leaf.keys, key, false)]);
+    return scanRecord(entry, key, leaf, slot);
+}
+
+bool Directory_Tree::scanRecord(const Directory_Entry& entry, const string& key, Node& leaf, size_t& slot)
+{
+    while (true)
+    {
+        for (slot = 0; slot < leaf.records.size(); slot++)
+        {
+            string recordName = recordKey(leaf.records[slot]);
+            if (recordName > key)
+                return false;
+            if (recordName == key && memcmp(leaf.records[slot].name, entry.dir_name, sizeof(entry.dir_name)) == 0)
+                return true;
+        }
+        if (leaf.next == 0)
+            return false;
+        leaf = readNode(leaf.next);
+    }
+}
+
+void Directory_Tree::encodeNode(const Node& node, span<char> out)
+{
+    fill(out.begin(), out.end(), 0);
+    copy(begin(NODE_TAG), end(NODE_TAG), out.begin());
+    out[KIND_OFFSET] = node.leaf ? LEAF_NODE : INTERNAL_NODE;
+    if (node.leaf)
+    {
+        putInt(out.data() + COUNT_OFFSET, static_cast<int>(node.records.size()));
+        putInt(out.data() + LINK_OFFSET, node.next);
+        if (!node.records.empty())
+            memcpy(out.data() + HEADER_SIZE, node.records.data(), node.records.size() * sizeof(Directory_Record));
+    }
+    else
+    {
+        putInt(out.data() + COUNT_OFFSET, static_cast<int>(node.keys.size()));
+        putInt(out.data() + LINK_OFFSET, node.children.front());
+        for (size_t i = 0; i < node.keys.size(); i++)
+        {
+            char* slot = out.data() + HEADER_SIZE + i * SLOT_SIZE;
+            memcpy(slot, node.keys[i].data(), min(node.keys[i].size(), KEY_SIZE));
+            putInt(slot + KEY_SIZE, node.children[i + 1]);
+        }
+    }
+}
+
+Directory_Tree::Node Directory_Tree::readNode(int cluster)
+{
+    size_t clusterSize = static_cast<size_t>(Mini_FAT::getClusterSize());
+    vector<char> bytes(clusterSize);
+    Virtual_Disk::readCluster(cluster, span<char>(bytes));
+
+    Node node;
+    node.cluster = cluster;
+    node.leaf = bytes[KIND_OFFSET] != INTERNAL_NODE;
+    size_t count = static_cast<size_t>(max(0, getInt(bytes.data() + COUNT_OFFSET)));
+    int link = getInt(bytes.data() + LINK_OFFSET);
+    if (node.leaf)
+    {
+        count = min(count, leafCapacity());
+        node.next = link;
+        node.records.resize(count);
+        if (count > 0)
+            memcpy(node.records.data(), bytes.data() + HEADER_SIZE, count * sizeof(Directory_Record));
+    }
+    else
+    {
+        count = min(count, internalCapacity());
+        node.children.push_back(link);
+        for (size_t i = 0; i < count; i++)
+        {
+            const char* slot = bytes.data() + HEADER_SIZE + i * SLOT_SIZE;
+            node.keys.emplace_back(slot, strnlen(slot, KEY_SIZE));
+            node.children.push_back(getInt(slot + KEY_SIZE));
+        }
+    }
+    return node;
+}
+
+void Directory_Tree::writeNode(const Node& node)
+{
+    vector<char> bytes(static_cast<size_t>(Mini_FAT::getClusterSize()));
+    encodeNode(node, bytes);
+    Virtual_Disk::writeCluster(span<const char>(bytes), node.cluster);
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include "Directory_Record.h"
+#include "Directory_Entry.h"
+#include "Mini_FAT.h"
+#include <span>
+#include <string>
+#include <vector>
+using namespace std;
+
+class Directory;
+
+/** B+tree layout for large directories. Every node is one cluster; leaves hold the 32-byte records sorted by
+    case-folded name and are linked left to right, internal nodes hold separator keys and child clusters.
+    The root stays in the directory's first cluster and all nodes are linked into the directory's own FAT chain,
+    so the parent entry never changes and freeing the chain frees the tree. A node starts with a zero byte,
+    which readers of the flat format take for an empty directory.
+    Deletes merge a nearly empty leaf into a sibling under the same parent; the node left behind stays in the chain
+    until the directory is rebuilt (see needsRebuild). */
+class Directory_Tree
+{
+public:
+    /** Whether the bytes of a directory's first cluster hold a tree node rather than flat records. */
+    static bool isTreeNode(span<const char> cluster);
+
+    /** Entry count above which a flat directory is converted to a tree (four clusters of records);
+        a tree with fewer than half as many entries goes back to the flat format. */
+    static size_t getThreshold();
+
+    /** Number of clusters a freshly built tree of 'entries' entries takes. */
+    static size_t nodesFor(size_t entries);
+
+    /** Writes 'entries' as a fresh tree over a newly allocated chain and returns the chain's runs, the root first
+        (nothing when the disk is full). */
+    static vector<Mini_FAT::Extent> build(const vector<Directory_Entry>& entries);
+
+    /** Appends every entry of the tree rooted at 'root' to 'out', in name order. */
+    static void readAll(int root, vector<Directory_Entry>& out);
+
+    /** Clusters an insert into the tree rooted at 'root' may take in the worst case: a split at every level plus
+        the two nodes a root split moves its halves into. */
+    static int splitReserve(int root);
+
+    /** Whether the disk has room for the worst-case split path of an insert into the directory's tree. */
+    static bool canInsert(const Directory& dir);
+
+    /** Whether a tree of 'clusters' clusters holding 'entries' entries carries enough merged-away nodes that
+        rebuilding it would give three quarters of it back. */
+    static bool needsRebuild(size_t clusters, size_t entries);
+
+    /** Inserts an entry, splitting nodes on the way back up; only the clusters on one root-to-leaf path are touched. */
+    static bool insert(Directory& dir, const Directory_Entry& entry);
+
+    /** Removes the entry with exactly the name bytes of 'entry', merging its leaf into a sibling when it is left
+        nearly empty and the two fit in one node. */
+    static bool erase(Directory& dir, const Directory_Entry& entry);
+
+    /** Rewrites the record of the entry named like 'old' with the fields of 'updated'. A new name moves the record,
+        which is only done once the disk has room for the worst-case split, so the record is never lost. */
+    static bool update(Directory& dir, const Directory_Entry& old, const Directory_Entry& updated);
+
+private:
+    /** A node as held in memory while it is read or changed. */
+    struct Node;
+
+    static Node readNode(int cluster);
+    static void writeNode(const Node& node);
+    static void encodeNode(const Node& node, span<char> out);
+
+    /** Finds the leaf and slot of the record with exactly these name bytes, starting from the leftmost leaf that may hold its key. */
+    static bool findRecord(int root, const Directory_Entry& entry, Node& leaf, size_t& slot);
+
+    /** Scans from 'leaf' rightwards for the record; 'leaf' ends up as the leaf holding it. */
+    static bool scanRecord(const Directory_Entry& entry, const string& key, Node& leaf, size_t& slot);
+
+    static string recordKey(const Directory_Record& record);
+    static size_t leafCapacity();
+    static size_t internalCapacity();
+};
@@ -0,0 +1,145 @@
+#include "Extent_Map.h"
+#include <algorithm>
+using namespace std;
+
+void Extent_Map::load(int firstCluster)
+{
+    // A map of the same chain is trusted as long as its ends still look right in the FAT
+    if (loaded && first == firstCluster)
+    {
+        if (firstCluster == 0 || runs.empty())
+            return;
+        if (Mini_FAT::getClusterPointer(firstCluster) != 0 && Mini_FAT::getClusterPointer(getLastCluster()) == -1)
+            return;
+    }
+
+    clear();
+    first = firstCluster;
+    loaded = true;
+    // A free first cluster means the chain was already released
+    if (firstCluster == 0 || Mini_FAT::getClusterPointer(firstCluster) == 0)
+        return;
+    for (int cluster : Mini_FAT::getClusterChain(firstCluster))
+        appendCluster(cluster);
+}
+
+void Extent_Map::assign(const vector<Mini_FAT::Extent>& extents)
+{
+    clear();
+    loaded = true;
+    for (const Mini_FAT::Extent& extent : extents)
+    {
+        runStarts.push_back(total);
+        runs.push_back(extent);
+        total += extent.length;
+    }
+    first = runs.empty() ? 0 : runs.front().first;
+}
+
+void Extent_Map::append(const vector<Mini_FAT::Extent>& extents)
+{
+    for (const Mini_FAT::Extent& extent : extents)
+    {
+        for (int cluster = extent.first; cluster < extent.first + extent.length; cluster++)
+            appendCluster(cluster);
+    }
+}
+
+void Extent_Map::truncate(int count)
+{
+    if (count < 1 || count >= total)
+        return;
+    // Whole runs past the new end go first, then the tail of the run the end falls in
+    while (runStarts.back() >= count)
+    {
+        for (int cluster = runs.back().first; cluster < runs.back().first + runs.back().length; cluster++)
+            Mini_FAT::setClusterPointer(cluster, 0);
+        runs.pop_back();
+        runStarts.pop_back();
+    }
+    Mini_FAT::Extent& last = runs.back();
+    int keep = static_cast<int>(count - runStarts.back());
+    for (int cluster = last.first + keep; cluster < last.first + last.length; cluster++)
+        Mini_FAT::setClusterPointer(cluster, 0);
+    last.length = keep;
+    Mini_FAT::setClusterPointer(last.first + keep - 1, -1);
+    total = count;
+}
+
+void Extent_Map::freeAll()
+{
+    for (const Mini_FAT::Extent& extent : runs)
+    {
+        for (int cluster = extent.first; cluster < extent.first + extent.length; cluster++)
+            Mini_FAT::setClusterPointer(cluster, 0);
+    }
+    clear();
+}
+
+void Extent_Map::clear()
+{
+    first = 0;
+    loaded = false;
+    runs.clear();
+    runStarts.clear();
+    total = 0;
+}
+
+int Extent_Map::getClusterCount() const
+{
+    return static_cast<int>(total);
+}
+
+int Extent_Map::getClusterAt(long long index) const
+{
+    if (index < 0 || index >= total)
+        return -1;
+    // The run holding 'index' is the last one starting at or before it
+    size_t run = static_cast<size_t>(upper_bound(runStarts.begin(), runStarts.end(), index) - runStarts.begin()) - 1;
+    return runs[run].first + static_cast<int>(index - runStarts[run]);
+}
+
+int Extent_Map::getClusterForOffset(long long offset) const
+{
+    if (offset < 0)
+        return -1;
+    return getClusterAt(offset / static_cast<long long>(Mini_FAT::getClusterSize()));
+}
+
+int Extent_Map::getLastCluster() const
+{
+    if (runs.empty())
+        return -1;
+    return runs.back().first + runs.back().length - 1;
+}
+
+vector<int> Extent_Map::getClusters(size_t limit) const
+{
+    vector<int> clusters;
+    clusters.reserve(static_cast<size_t>(min<long long>(total, static_cast<long long>(min<size_t>(limit, INT32_MAX)))));
+    for (const Mini_FAT::Extent& extent : runs)
+    {
+        for (int cluster = extent.first; cluster < extent.first + extent.length && clusters.size() < limit; cluster++)
+            clusters.push_back(cluster);
+    }
+    return clusters;
+}
+
+const vector<Mini_FAT::Extent>& Extent_Map::getExtents() const
+{
+    return runs;
+}
+
+void Extent_Map::appendCluster(int cluster)
+{
+    if (!runs.empty() && runs.back().first + runs.back().length == cluster)
+    {
+        runs.back().length++;
+    }
+    else
+    {
+        runStarts.push_back(total);
+        runs.push_back({ cluster, 1 });
+    }
+    total++;
+}
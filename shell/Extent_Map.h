@@ -0,0 +1,61 @@
+#pragma once
+#include "Mini_FAT.h"
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+/** In-memory copy of one file's or directory's cluster chain as runs of adjacent clusters.
+    Built from the FAT once, then kept current by whoever allocates or frees the chain, so sizes need no FAT walk
+    and a byte offset maps to its cluster with a binary search over the runs. */
+class Extent_Map
+{
+public:
+    /** Makes the map describe the chain starting at 'firstCluster' (0 for none). The FAT is walked only when the map
+        does not already describe that chain. */
+    void load(int firstCluster);
+
+    /** Replaces the map with a chain just allocated as 'extents'. */
+    void assign(const vector<Mini_FAT::Extent>& extents);
+
+    /** Adds runs just linked onto the end of the chain. */
+    void append(const vector<Mini_FAT::Extent>& extents);
+
+    /** Frees the clusters after the first 'count' in the FAT and ends the chain there (count must be at least 1). */
+    void truncate(int count);
+
+    /** Frees every cluster of the chain in the FAT and empties the map. */
+    void freeAll();
+
+    /** Empties the map without touching the FAT. */
+    void clear();
+
+    /** Number of clusters in the chain. */
+    int getClusterCount() const;
+
+    /** Cluster holding the 'index'-th cluster of the chain, or -1 past the end. */
+    int getClusterAt(long long index) const;
+
+    /** Cluster holding byte 'offset' of the file, or -1 past the end. */
+    int getClusterForOffset(long long offset) const;
+
+    /** Last cluster of the chain, or -1 when it is empty. */
+    int getLastCluster() const;
+
+    /** Lists the chain's clusters in order, stopping after 'limit' of them. */
+    vector<int> getClusters(size_t limit = SIZE_MAX) const;
+
+    const vector<Mini_FAT::Extent>& getExtents() const;
+
+private:
+    /** Adds one cluster at the end of the chain, growing the last run when it is adjacent. */
+    void appendCluster(int cluster);
+
+    /** First cluster of the chain the map describes, and whether it describes one at all. */
+    int first = 0;
+    bool loaded = false;
+
+    /** The runs in chain order, and how many clusters come before each of them. */
+    vector<Mini_FAT::Extent> runs;
+    vector<long long> runStarts;
+    long long total = 0;
+};
@@ -1,111 +1,83 @@
 #include "File_Entry.h"
+#include "File_Handle.h"
+#include <algorithm>
+#include <cstdint>
 using namespace std;
 
 File_Entry::File_Entry(string name, char dir_attr, int dir_firstCluster, Directory* pa)
-    : Directory_Entry(name, dir_attr, dir_firstCluster) , content("")
+    : Directory_Entry(name, dir_attr, dir_firstCluster) , content(""), parent(pa)
 {
-    if (pa != nullptr)
-    {
-        parent = pa;
-    }
 }
 
 File_Entry :: File_Entry(Directory_Entry d,Directory * pa)
-    :Directory_Entry (d.dir_name, d.dir_attr, d.dir_firstCluster)
+    :Directory_Entry (d), content(""), parent(pa)
 {
-    for (size_t i = 0; i < 12; i++)
-    {
-        dir_empty[i] = d.dir_empty[i];
-    }
-    dir_fileSize = d.dir_fileSize;
-    content = "";
-    if (pa != nullptr)
-    {
-       this -> parent = pa;
-    }
 }
 
 int File_Entry::getMySizeOnDisk()
 {
-    int size = 0;
-    if (dir_firstCluster != 0)
-    {
-        int cluster = dir_firstCluster;
-        int next = Mini_FAT::getClusterPointer(cluster);
-        do
-        {
-            size++;
-            cluster = next;
-            if (cluster != -1)
-                next = Mini_FAT::getClusterPointer(cluster);
-        } while (cluster != -1);
-    }
-    return size;
+    extents.load(dir_firstCluster);
+    return extents.getClusterCount();
 }
 
 void File_Entry::emptyMyClusters()
 {
-    if (dir_firstCluster != 0)
-    {
-        int cluster = dir_firstCluster;
-        int next = Mini_FAT::getClusterPointer(cluster);
-        do
-        {
-            Mini_FAT::setClusterPointer(cluster, 0);
-            cluster = next;
-            if (cluster != -1)
-                next = Mini_FAT::getClusterPointer(cluster);
-        } while (cluster != -1);
-    }
+    // An already released chain loads as empty, so nothing is freed twice
+    File_Handle::forgetTail(dir_firstCluster);
+    if (isFramed() && dir_firstCluster != 0)
+        File_Handle::freeFrames(*this);
+    extents.load(dir_firstCluster);
+    extents.freeAll();
+    setFramed(false);
 }
 
 Directory_Entry File_Entry::getDirectory_Entry()
 {
-    Directory_Entry M(dir_name, dir_attr, dir_firstCluster);
-    for (size_t i = 0; i < 12; i++)
-    {
-        M.dir_empty[i] = dir_empty[i];
-    }
-    M.dir_fileSize = dir_fileSize;
+    Directory_Entry M(*this);
     return M;
 }
 
 void File_Entry::writeFileContent()
 {
+    if (Mini_FAT::hasCompression() || Mini_FAT::hasDeduplication())
+    {
+        // Frames are compressed or shared on the way out by a handle, which also records the entry
+        File_Handle handle;
+        handle.open(getDirectory_Entry(), parent, File_Handle::Mode::Write);
+        handle.write(span<const char>(content.data(), content.size()));
+        handle.close();
+        static_cast<Directory_Entry&>(*this) = handle.getEntry();
+        return;
+    }
     Directory_Entry A = this->getDirectory_Entry();
+    if (!Mini_FAT::hasLargeFiles() && content.size() > static_cast<size_t>(INT32_MAX))
+    {
+        cout << "Error: Files larger than 2 GiB need a volume formatted with large-file support.\n";
+        return;
+    }
     if (!content.empty())
     {
-        vector<char> contentBYTES = Converter::StringToBytes(content);
-        vector<vector<char>> bytesList = Converter::splitBytes(contentBYTES);
-        int clusterFATIndex;
-        if (dir_firstCluster != 0)
-        {
-            emptyMyClusters();
-            clusterFATIndex = Mini_FAT::getAvailableCluster();
-            dir_firstCluster = clusterFATIndex;
-        }
-        else
-        {
-            clusterFATIndex = Mini_FAT::getAvailableCluster();
-            if (clusterFATIndex != 0)
-                this->dir_firstCluster = clusterFATIndex;
-        }
-        int lastCluster = -1;
-        for (int i = 0; i < bytesList.size(); i++)
+        // The content string is written in place; its length is recorded in the entry instead of a terminator
+        span<const char> bytes(content.data(), content.size());
+        size_t clusterSize = Virtual_Disk::getClusterSize();
+        size_t clusterCount = (bytes.size() + clusterSize - 1) / clusterSize;
+        if (clusterCount > static_cast<size_t>(getMySizeOnDisk() + Mini_FAT::getAvailableClusters()))
         {
-            if (clusterFATIndex != -1)
-            {
-                Virtual_Disk::writeCluster(bytesList[i], clusterFATIndex);
-                Mini_FAT::setClusterPointer(clusterFATIndex, -1);
-                if (lastCluster != -1)
-                    Mini_FAT::setClusterPointer(lastCluster, clusterFATIndex);
-                lastCluster = clusterFATIndex;
-                clusterFATIndex = Mini_FAT::getAvailableCluster();
-            }
+            cout << "Error: Not enough free space on the disk to write the file.\n";
+            return;
         }
+        dir_fileSize = static_cast<long long>(content.size());
+        if (dir_firstCluster != 0)
+            emptyMyClusters();
+        // Ask for the whole chain at once so the file lands in as few runs as the free space allows
+        extents.assign(Mini_FAT::allocateClusters(static_cast<int>(clusterCount)));
+        vector<int> chain = extents.getClusters();
+        dir_firstCluster = chain.front();
+        Virtual_Disk::writeClusters(chain, bytes);
     }
     if (content.empty())
     {
+        dir_fileSize = 0;
         if (dir_firstCluster != 0)
             emptyMyClusters();
         if (parent != nullptr)
@@ -115,30 +87,26 @@ void File_Entry::writeFileContent()
     if (parent != nullptr)
     {
         parent->updatecontent(A, B);
-        parent->writeDirectory();
     }
-
-    Mini_FAT::writeFAT();
 }
 
 void File_Entry::readFileContent()
 {
-    if (dir_firstCluster != 0)
+    if (isFramed() && dir_firstCluster != 0)
     {
-        content = "";
-        int cluster = this->dir_firstCluster;
-        int next = Mini_FAT::getClusterPointer(cluster);
-        vector<char> ls;
-        do
-        {
-            vector<char> clusterData = Virtual_Disk::readCluster(cluster);
-            ls.insert(ls.end(), clusterData.begin(), clusterData.end());
-            cluster = next;
-            if (cluster != -1)
-                next = Mini_FAT::getClusterPointer(cluster);
-        } while (cluster != -1);
-
-        content = Converter::BytesToString(ls);
+        content.assign(static_cast<size_t>(dir_fileSize), '\0');
+        File_Handle handle;
+        handle.open(getDirectory_Entry(), parent, File_Handle::Mode::Read);
+        content.resize(handle.read(span<char>(content.data(), content.size())));
+    }
+    else if (dir_firstCluster != 0)
+    {
+        // The content string is sized once from the entry and the chain is read straight into it
+        content.assign(static_cast<size_t>(dir_fileSize), '\0');
+        size_t clusterSize = Virtual_Disk::getClusterSize();
+        extents.load(dir_firstCluster);
+        vector<int> chain = extents.getClusters(max<size_t>(1, (content.size() + clusterSize - 1) / clusterSize));
+        Virtual_Disk::readClusters(chain, span<char>(content.data(), content.size()));
     }
 }
 
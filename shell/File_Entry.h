@@ -1,6 +1,7 @@
 #pragma once
 #include "Directory.h"
 #include"Directory_Entry.h"
+#include "Extent_Map.h"
 #include<string>
 using namespace std;
 
@@ -9,6 +10,9 @@ class File_Entry : public Directory_Entry
 public:
     string content;
     Directory* parent;
+
+    /** The file's clusters, loaded from the FAT on first use. */
+    Extent_Map extents;
     
     File_Entry(string name, char dir_attr, int dir_firstCluster, Directory* pa);
 
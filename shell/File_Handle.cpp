@@ -0,0 +1,877 @@
+#include "File_Handle.h"
+#include "Cluster_Cache.h"
+#include "Converter.h"
+#include "Dedup_Table.h"
+#include "LZ_Codec.h"
+#include "Virtual_Disk.h"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+unordered_map<int, File_Handle::Tail> File_Handle::tails;
+long long File_Handle::frameBytesIn = 0;
+long long File_Handle::frameBytesOut = 0;
+
+static_assert(sizeof(int) == 4, "index records are pairs of 32-bit ints");
+
+// Largest size a file may reach on the mounted volume
+static long long getSizeLimit()
+{
+    return Mini_FAT::hasLargeFiles() ? LLONG_MAX : INT32_MAX;
+}
+
+File_Handle::File_Handle()
+    : file(Directory_Entry(), nullptr)
+{
+}
+
+File_Handle::~File_Handle()
+{
+    close();
+}
+
+bool File_Handle::open(const Directory_Entry& entry, Directory* parent, Mode openMode)
+{
+    close();
+    if (entry.dir_attr == 0x10)
+        return false;
+    file = File_Entry(entry, parent);
+    opened = entry;
+    mode = openMode;
+    position = 0;
+    bufferIndex = -1;
+    bufferCluster = -1;
+    bufferDirty = false;
+    extentBase = 0;
+    frames.clear();
+    indexDirtyFrom = LLONG_MAX;
+    if (mode == Mode::Write)
+    {
+        // The old chain goes now; close records the empty file even if nothing is written.
+        // What is written next takes the volume's layout, whatever the old content had
+        if (file.dir_firstCluster != 0)
+            file.emptyMyClusters();
+        file.dir_firstCluster = 0;
+        file.dir_fileSize = 0;
+        file.setFramed(false);
+        framed = Mini_FAT::hasCompression() || Mini_FAT::hasDeduplication();
+    }
+    else
+    {
+        framed = file.isFramed() && file.dir_firstCluster != 0;
+    }
+    buffer.assign(static_cast<size_t>(framed ? getFrameSize() : static_cast<long long>(Virtual_Disk::getClusterSize())), '\0');
+    if (framed)
+        readIndex(file, file.extents, frames);
+    else if (mode == Mode::Append)
+        findTail();
+    else
+        file.extents.load(file.dir_firstCluster);
+    if (mode == Mode::Append)
+        position = file.dir_fileSize;
+    openFlag = true;
+    return true;
+}
+
+size_t File_Handle::read(span<char> out)
+{
+    if (!openFlag || mode == Mode::Append)
+        return 0;
+    size_t blockSize = buffer.size();
+    size_t done = 0;
+    while (done < out.size() && position < file.dir_fileSize)
+    {
+        long long index = position / static_cast<long long>(blockSize);
+        size_t offset = static_cast<size_t>(position % static_cast<long long>(blockSize));
+        size_t count = min({ out.size() - done, blockSize - offset, static_cast<size_t>(file.dir_fileSize - position) });
+        if (!loadBlock(index, true))
+            break;
+        memcpy(out.data() + done, buffer.data() + offset, count);
+        done += count;
+        position += static_cast<long long>(count);
+    }
+    return done;
+}
+
+size_t File_Handle::write(span<const char> data)
+{
+    if (!openFlag || mode == Mode::Read || data.empty())
+        return 0;
+    long long limit = getSizeLimit();
+    if (static_cast<long long>(data.size()) > limit - position)
+    {
+        cout << "Error: Files larger than 2 GiB need a volume formatted with large-file support.\n";
+        data = data.first(static_cast<size_t>(limit - position));
+    }
+
+    // The clusters for the whole write are linked at once, so it lands in as few runs as the free space allows
+    long long blockSize = static_cast<long long>(buffer.size());
+    long long end = position + static_cast<long long>(data.size());
+    if (!growTo((end + blockSize - 1) / blockSize))
+    {
+        cout << "Error: Not enough free space on the disk to write the file.\n";
+        long long blocks = framed ? static_cast<long long>(frames.size()) : extentBase + file.extents.getClusterCount();
+        long long room = blocks * blockSize - position;
+        data = data.first(static_cast<size_t>(max(0LL, min(room, static_cast<long long>(data.size())))));
+    }
+
+    size_t done = 0;
+    while (done < data.size())
+    {
+        long long index = position / blockSize;
+        size_t offset = static_cast<size_t>(position % blockSize);
+        size_t count = min(data.size() - done, buffer.size() - offset);
+        // Old bytes of the block survive unless the write covers all of them
+        long long blockStart = index * blockSize;
+        bool keep = blockStart < file.dir_fileSize
+            && !(offset == 0 && static_cast<long long>(count) >= min(blockSize, file.dir_fileSize - blockStart));
+        if (!loadBlock(index, keep))
+            break;
+        memcpy(buffer.data() + offset, data.data() + done, count);
+        bufferDirty = true;
+        done += count;
+        position += static_cast<long long>(count);
+        file.dir_fileSize = max(file.dir_fileSize, position);
+    }
+    return done;
+}
+
+size_t File_Handle::readAt(long long offset, span<char> out)
+{
+    if (!openFlag || offset < 0 || offset > file.dir_fileSize)
+        return 0;
+    long long saved = position;
+    position = offset;
+    size_t done = read(out);
+    position = saved;
+    return done;
+}
+
+size_t File_Handle::writeAt(long long offset, span<const char> data)
+{
+    if (!openFlag || mode == Mode::Append || offset < 0 || offset > file.dir_fileSize)
+        return 0;
+    long long saved = position;
+    position = offset;
+    size_t done = write(data);
+    position = saved;
+    return done;
+}
+
+bool File_Handle::reserve(long long size)
+{
+    if (!openFlag || mode == Mode::Read)
+        return false;
+    long long blockSize = static_cast<long long>(buffer.size());
+    if (!growTo((size + blockSize - 1) / blockSize))
+    {
+        cout << "Error: Not enough free space on the disk to write the file.\n";
+        return false;
+    }
+    return true;
+}
+
+bool File_Handle::seek(long long offset)
+{
+    if (!openFlag || mode == Mode::Append || offset < 0 || offset > file.dir_fileSize)
+        return false;
+    position = offset;
+    return true;
+}
+
+long long File_Handle::tell() const
+{
+    return position;
+}
+
+long long File_Handle::getSize() const
+{
+    return file.dir_fileSize;
+}
+
+bool File_Handle::isOpen() const
+{
+    return openFlag;
+}
+
+long long File_Handle::copyTo(ostream& out, long long length)
+{
+    // Whole blocks go straight from the buffer to the stream, once a large plain file has streamed what it can in bulk
+    long long moved = 0;
+    size_t blockSize = buffer.size();
+    long long end = file.dir_fileSize - position > length ? position + length : file.dir_fileSize;
+    if (openFlag && mode != Mode::Append && !framed && position % static_cast<long long>(blockSize) == 0 && isBulk(end - position))
+    {
+        bool failed = false;
+        moved = streamTo(out, end, failed);
+        if (failed)
+            return moved;
+    }
+    while (openFlag && mode != Mode::Append && position < end)
+    {
+        long long index = position / static_cast<long long>(blockSize);
+        size_t offset = static_cast<size_t>(position % static_cast<long long>(blockSize));
+        size_t count = min(blockSize - offset, static_cast<size_t>(end - position));
+        if (!loadBlock(index, true))
+            break;
+        out.write(buffer.data() + offset, static_cast<streamsize>(count));
+        position += static_cast<long long>(count);
+        moved += static_cast<long long>(count);
+    }
+    return moved;
+}
+
+long long File_Handle::copyFrom(istream& in)
+{
+    if (openFlag && mode != Mode::Read && !framed && position % static_cast<long long>(buffer.size()) == 0)
+    {
+        bool failed = false;
+        return streamFrom(in, failed);
+    }
+    long long moved = 0;
+    vector<char> chunk(buffer.size());
+    while (in)
+    {
+        in.read(chunk.data(), static_cast<streamsize>(chunk.size()));
+        size_t count = static_cast<size_t>(in.gcount());
+        if (count == 0)
+            break;
+        size_t written = write(span<const char>(chunk.data(), count));
+        moved += static_cast<long long>(written);
+        if (written < count)
+            break;
+    }
+    return moved;
+}
+
+long long File_Handle::copyFrom(File_Handle& source)
+{
+    // Between plain files whole windows go disk to disk; the rest is written from the source's buffer directly,
+    // one of its blocks at a time
+    long long moved = 0;
+    size_t blockSize = source.buffer.size();
+    if (openFlag && mode != Mode::Read && !framed && source.openFlag && source.mode != Mode::Append && !source.framed
+        && blockSize == buffer.size() && position % static_cast<long long>(blockSize) == 0
+        && source.position % static_cast<long long>(blockSize) == 0)
+    {
+        bool failed = false;
+        moved = streamFrom(source, failed);
+        if (failed)
+            return moved;
+    }
+    while (source.openFlag && source.position < source.file.dir_fileSize)
+    {
+        long long index = source.position / static_cast<long long>(blockSize);
+        size_t offset = static_cast<size_t>(source.position % static_cast<long long>(blockSize));
+        size_t count = min(blockSize - offset, static_cast<size_t>(source.file.dir_fileSize - source.position));
+        if (!source.loadBlock(index, true))
+            break;
+        size_t written = write(span<const char>(source.buffer.data() + offset, count));
+        source.position += static_cast<long long>(written);
+        moved += static_cast<long long>(written);
+        if (written < count)
+            break;
+    }
+    return moved;
+}
+
+const Directory_Entry& File_Handle::getEntry() const
+{
+    return file;
+}
+
+void File_Handle::close()
+{
+    if (!openFlag)
+        return;
+    flushBuffer();
+    openFlag = false;
+    if (mode == Mode::Read)
+    {
+        buffer.clear();
+        buffer.shrink_to_fit();
+        packed.clear();
+        packed.shrink_to_fit();
+        return;
+    }
+    long long blockSize = static_cast<long long>(buffer.size());
+    long long used = (file.dir_fileSize + blockSize - 1) / blockSize;
+    if (framed)
+    {
+        // Frames past the end go with their chains, and the index is brought up to date
+        for (size_t i = static_cast<size_t>(used); i < frames.size(); i++)
+            releaseFrame(frames[i].cluster);
+        frames.resize(static_cast<size_t>(used));
+        if (!Mini_FAT::hasDeduplication() && !frames.empty() && all_of(frames.begin(), frames.end(), [](const Frame& frame) { return (frame.length & RAW_FRAME) != 0; }))
+        {
+            // Nothing compressed: the frames, all whole but the last, are linked into a plain chain and the index goes
+            for (size_t i = 0; i + 1 < frames.size(); i++)
+            {
+                Extent_Map chain;
+                chain.load(frames[i].cluster);
+                Mini_FAT::setClusterPointer(chain.getLastCluster(), frames[i + 1].cluster);
+            }
+            file.extents.freeAll();
+            file.dir_firstCluster = frames.front().cluster;
+            frames.clear();
+            framed = false;
+        }
+        else if (!storeIndex())
+        {
+            // Without its index the data cannot be found again, so the file is left empty
+            cout << "Error: Not enough free space on the disk to write the file.\n";
+            for (const Frame& frame : frames)
+                releaseFrame(frame.cluster);
+            frames.clear();
+            file.dir_fileSize = 0;
+            storeIndex();
+        }
+        file.setFramed(framed && file.dir_firstCluster != 0);
+    }
+    else if (used == 0 && file.dir_firstCluster != 0)
+    {
+        forgetTail(file.dir_firstCluster);
+        file.extents.freeAll();
+        file.dir_firstCluster = 0;
+    }
+    else if (used > extentBase && used < extentBase + file.extents.getClusterCount())
+    {
+        file.extents.truncate(static_cast<int>(used - extentBase));
+    }
+
+    // The next append to this file starts from its tail without walking the chain
+    if (!framed && file.dir_firstCluster != 0 && file.extents.getClusterCount() > 0)
+    {
+        if (tails.size() >= TAIL_CAPACITY && tails.find(file.dir_firstCluster) == tails.end())
+            tails.clear();
+        tails[file.dir_firstCluster] = { file.extents.getLastCluster(), extentBase + file.extents.getClusterCount() };
+    }
+    if (file.parent != nullptr)
+        file.parent->updatecontent(opened, file.getDirectory_Entry());
+    buffer.clear();
+    buffer.shrink_to_fit();
+    packed.clear();
+    packed.shrink_to_fit();
+}
+
+bool File_Handle::isBulk(long long bytes) const
+{
+    return bytes > static_cast<long long>(Cluster_Cache::ADMIT_LIMIT * buffer.size());
+}
+
+long long File_Handle::getWindowSize() const
+{
+    size_t fewest = Cluster_Cache::ADMIT_LIMIT * 2;
+    size_t most = Virtual_Disk::RUN_LIMIT;
+    size_t clusters = clamp(BULK_WINDOW_BYTES / buffer.size(), fewest, most);
+    return static_cast<long long>(clusters * buffer.size());
+}
+
+bool File_Handle::mapClusters(long long start, long long length, vector<int>& clusters) const
+{
+    long long clusterSize = static_cast<long long>(buffer.size());
+    clusters.clear();
+    for (long long block = start / clusterSize; block * clusterSize < start + length; block++)
+    {
+        int cluster = block < extentBase ? -1 : file.extents.getClusterAt(block - extentBase);
+        if (cluster == -1)
+            return false;
+        clusters.push_back(cluster);
+    }
+    return true;
+}
+
+size_t File_Handle::getBulkLength(size_t count) const
+{
+    size_t partial = count % buffer.size();
+    if (partial != 0 && position + static_cast<long long>(count) < file.dir_fileSize)
+        return count - partial;
+    return count;
+}
+
+long long File_Handle::streamTo(ostream& out, long long end, bool& failed)
+{
+    // Windows are read ahead through queued requests and go to the stream in file order as each one arrives
+    long long windowSize = getWindowSize();
+    vector<Bulk_Window> windows(BULK_DEPTH);
+    long long queuedTo = position;
+    size_t queued = 0;
+    size_t written = 0;
+    long long moved = 0;
+    while (written < queued || queuedTo < end)
+    {
+        if (queuedTo < end && queued - written < windows.size())
+        {
+            Bulk_Window& window = windows[queued % windows.size()];
+            window.length = static_cast<size_t>(min(windowSize, end - queuedTo));
+            if (!mapClusters(queuedTo, static_cast<long long>(window.length), window.clusters))
+            {
+                // A chain shorter than the file: what is left goes to the block-by-block path
+                end = queuedTo;
+                continue;
+            }
+            window.bytes.resize(window.clusters.size() * buffer.size());
+            window.busy = true;
+            Virtual_Disk::submitReadClusters(window.clusters, span<char>(window.bytes), [&window](bool ok) {
+                window.failed = !ok;
+                window.busy = false;
+                });
+            queuedTo += static_cast<long long>(window.length);
+            queued++;
+            continue;
+        }
+        Bulk_Window& window = windows[written % windows.size()];
+        while (window.busy && Virtual_Disk::waitForAnyTransfer())
+        {
+        }
+        if (window.failed)
+        {
+            // The stream gets nothing past the last window that was read whole; the windows still queued must
+            // arrive before their bytes go away
+            failed = true;
+            Virtual_Disk::waitForTransfers();
+            break;
+        }
+        out.write(window.bytes.data(), static_cast<streamsize>(window.length));
+        position += static_cast<long long>(window.length);
+        moved += static_cast<long long>(window.length);
+        written++;
+    }
+    return moved;
+}
+
+long long File_Handle::streamFrom(istream& in, bool& failed)
+{
+    // Windows are filled from the stream and queued as bulk writes, each refilled once its write has finished.
+    // A window too small for the bulk path (the end of the input), or one the disk cannot take, goes through write()
+    long long clusterSize = static_cast<long long>(buffer.size());
+    long long windowSize = getWindowSize();
+    vector<Bulk_Window> windows(BULK_DEPTH);
+    long long from = position;
+    long long moved = 0;
+    for (size_t next = 0; in; next++)
+    {
+        Bulk_Window& window = windows[next % windows.size()];
+        while (window.busy && Virtual_Disk::waitForAnyTransfer())
+        {
+        }
+        if (window.failed)
+            break;
+        window.bytes.resize(static_cast<size_t>(windowSize));
+        in.read(window.bytes.data(), static_cast<streamsize>(windowSize));
+        size_t count = static_cast<size_t>(in.gcount());
+        if (count == 0)
+            break;
+        window.length = getBulkLength(count);
+        long long length = static_cast<long long>(window.length);
+        if (isBulk(length) && length <= getSizeLimit() - position && growTo((position + length + clusterSize - 1) / clusterSize)
+            && mapClusters(position, length, window.clusters) && flushBuffer())
+        {
+            // The buffer must not keep an older copy of a block the window overwrites
+            bufferIndex = -1;
+            window.start = position;
+            window.busy = true;
+            Virtual_Disk::submitWriteClusters(window.clusters, span<const char>(window.bytes.data(), window.length), [&window](bool ok) {
+                window.failed = !ok;
+                window.busy = false;
+                });
+            position += length;
+            file.dir_fileSize = max(file.dir_fileSize, position);
+            moved += length;
+        }
+        else
+        {
+            window.length = 0;
+        }
+        if (window.length < count)
+        {
+            size_t rest = count - window.length;
+            size_t done = write(span<const char>(window.bytes.data() + window.length, rest));
+            moved += static_cast<long long>(done);
+            if (done < rest)
+                break;
+        }
+    }
+
+    // The windows' bytes must outlive their writes
+    Virtual_Disk::waitForTransfers();
+    long long kept = cutAtFailure(windows, from);
+    failed = kept < moved;
+    return min(moved, kept);
+}
+
+long long File_Handle::streamFrom(File_Handle& source, bool& failed)
+{
+    // A window is read from the source and written from the read's completion, so reads and writes of different
+    // windows overlap; it is reused once its write has finished
+    long long clusterSize = static_cast<long long>(buffer.size());
+    long long windowSize = getWindowSize();
+    vector<Bulk_Window> windows(BULK_DEPTH);
+    long long from = position;
+    long long sourceFrom = source.position;
+    long long moved = 0;
+    for (size_t next = 0; source.position < source.file.dir_fileSize; next++)
+    {
+        Bulk_Window& window = windows[next % windows.size()];
+        while (window.busy && Virtual_Disk::waitForAnyTransfer())
+        {
+        }
+        if (window.failed)
+            break;
+        window.length = getBulkLength(static_cast<size_t>(min(windowSize, source.file.dir_fileSize - source.position)));
+        long long length = static_cast<long long>(window.length);
+        if (!isBulk(length) || length > getSizeLimit() - position
+            || !source.mapClusters(source.position, length, window.sourceClusters)
+            || !growTo((position + length + clusterSize - 1) / clusterSize)
+            || !mapClusters(position, length, window.clusters) || !flushBuffer())
+        {
+            break;
+        }
+        bufferIndex = -1;
+        window.bytes.resize(window.sourceClusters.size() * buffer.size());
+        window.start = position;
+        window.busy = true;
+        // A window whose read failed is not written: its bytes are not the source's
+        Virtual_Disk::submitReadClusters(window.sourceClusters, span<char>(window.bytes), [&window](bool read) {
+            if (!read)
+            {
+                window.failed = true;
+                window.busy = false;
+                return;
+            }
+            Virtual_Disk::submitWriteClusters(window.clusters, span<const char>(window.bytes.data(), window.length), [&window](bool ok) {
+                window.failed = !ok;
+                window.busy = false;
+                });
+            });
+        source.position += length;
+        position += length;
+        file.dir_fileSize = max(file.dir_fileSize, position);
+        moved += length;
+    }
+    Virtual_Disk::waitForTransfers();
+    long long kept = cutAtFailure(windows, from);
+    failed = kept < moved;
+    if (failed)
+        source.position = sourceFrom + kept;
+    return min(moved, kept);
+}
+
+long long File_Handle::cutAtFailure(const vector<Bulk_Window>& windows, long long from)
+{
+    long long cut = -1;
+    for (const Bulk_Window& window : windows)
+    {
+        if (window.failed && (cut == -1 || window.start < cut))
+            cut = window.start;
+    }
+    if (cut == -1)
+        return position - from;
+    file.dir_fileSize = min(file.dir_fileSize, max(cut, from));
+    position = min(position, file.dir_fileSize);
+    cout << "Error: '" << file.getName() << "' was cut short at " << file.dir_fileSize << " bytes.\n";
+    return position - from;
+}
+
+bool File_Handle::loadBlock(long long index, bool keep)
+{
+    if (index == bufferIndex)
+        return true;
+    if (!flushBuffer())
+        return false;
+    if (framed)
+    {
+        if (index >= static_cast<long long>(frames.size()))
+            return false;
+        if (keep && frames[index].cluster != 0)
+        {
+            if (!loadFrame(index))
+                return false;
+        }
+        else
+        {
+            fill(buffer.begin(), buffer.end(), '\0');
+        }
+        bufferIndex = index;
+        return true;
+    }
+    int cluster = index < extentBase ? -1 : file.extents.getClusterAt(index - extentBase);
+    if (cluster == -1)
+        return false;
+    if (keep)
+        Virtual_Disk::readCluster(cluster, span<char>(buffer.data(), buffer.size()));
+    else
+        fill(buffer.begin(), buffer.end(), '\0');
+    bufferIndex = index;
+    bufferCluster = cluster;
+    return true;
+}
+
+bool File_Handle::flushBuffer()
+{
+    if (!bufferDirty)
+        return true;
+    if (framed)
+    {
+        if (!storeFrame())
+        {
+            // The file ends where the frame that did not fit began; close frees the frames after it
+            file.dir_fileSize = bufferIndex * static_cast<long long>(buffer.size());
+            position = min(position, file.dir_fileSize);
+            bufferIndex = -1;
+            bufferDirty = false;
+            cout << "Error: '" << file.getName() << "' was cut short at " << file.dir_fileSize << " bytes.\n";
+            return false;
+        }
+    }
+    else
+    {
+        Virtual_Disk::writeCluster(span<const char>(buffer.data(), buffer.size()), bufferCluster);
+    }
+    bufferDirty = false;
+    return true;
+}
+
+bool File_Handle::loadFrame(long long index)
+{
+    const Frame& frame = frames[static_cast<size_t>(index)];
+    long long frameSize = static_cast<long long>(buffer.size());
+    size_t length = static_cast<size_t>(min(frameSize, file.dir_fileSize - index * frameSize));
+    size_t stored = static_cast<size_t>(frame.length & ~RAW_FRAME);
+    Extent_Map chain;
+    chain.load(frame.cluster);
+    size_t clusterSize = Virtual_Disk::getClusterSize();
+    bool intact = stored <= static_cast<size_t>(chain.getClusterCount()) * clusterSize;
+    if (intact && (frame.length & RAW_FRAME) != 0)
+    {
+        intact = stored == length;
+        if (intact)
+            Virtual_Disk::readClusters(chain.getClusters(), span<char>(buffer.data(), length));
+    }
+    else if (intact)
+    {
+        packed.resize(stored);
+        Virtual_Disk::readClusters(chain.getClusters(), span<char>(packed.data(), stored));
+        intact = LZ_Codec::decompress(span<const char>(packed.data(), stored), span<char>(buffer.data(), length));
+    }
+    if (!intact)
+    {
+        cout << "Error: '" << file.getName() << "' is damaged at byte " << index * frameSize << ".\n";
+        return false;
+    }
+    fill(buffer.begin() + static_cast<ptrdiff_t>(length), buffer.end(), '\0');
+    return true;
+}
+
+bool File_Handle::storeFrame()
+{
+    long long frameSize = static_cast<long long>(buffer.size());
+    size_t length = static_cast<size_t>(min(frameSize, file.dir_fileSize - bufferIndex * frameSize));
+    size_t clusterSize = Virtual_Disk::getClusterSize();
+    bool raw = true;
+    if (Mini_FAT::hasCompression())
+    {
+        LZ_Codec::compress(span<const char>(buffer.data(), length), packed);
+        // Data that does not compress by at least a cluster is kept as it is, which costs nothing to read back
+        raw = (packed.size() + clusterSize - 1) / clusterSize >= (length + clusterSize - 1) / clusterSize;
+    }
+    span<const char> stored = raw ? span<const char>(buffer.data(), length) : span<const char>(packed.data(), packed.size());
+    int needed = static_cast<int>((stored.size() + clusterSize - 1) / clusterSize);
+    frameBytesIn += static_cast<long long>(length);
+    frameBytesOut += static_cast<long long>(stored.size());
+
+    Frame& frame = frames[static_cast<size_t>(bufferIndex)];
+    uint64_t hash = 0;
+    if (Mini_FAT::hasDeduplication())
+    {
+        // Bytes already on the volume are shared instead of written again
+        hash = Dedup_Table::hash(stored);
+        int match = Dedup_Table::find(hash, stored);
+        if (match != -1 && (match == frame.cluster || Dedup_Table::share(match)))
+        {
+            if (match != frame.cluster)
+                releaseFrame(frame.cluster);
+            frame.cluster = match;
+            frame.length = static_cast<int>(stored.size()) | (raw ? RAW_FRAME : 0);
+            indexDirtyFrom = min(indexDirtyFrom, bufferIndex);
+            return true;
+        }
+        // Copy on write: a chain other files still share is left to them, and the frame gets a new one
+        if (frame.cluster != 0 && !Dedup_Table::release(frame.cluster))
+            frame.cluster = 0;
+    }
+    Extent_Map chain;
+    chain.load(frame.cluster);
+    if (needed != chain.getClusterCount())
+    {
+        if (needed > chain.getClusterCount() + Mini_FAT::getAvailableClusters())
+        {
+            cout << "Error: Not enough free space on the disk to write the file.\n";
+            return false;
+        }
+        chain.freeAll();
+        chain.assign(Mini_FAT::allocateClusters(needed));
+        frame.cluster = chain.getExtents().front().first;
+    }
+    Virtual_Disk::writeClusters(chain.getClusters(), stored);
+    frame.length = static_cast<int>(stored.size()) | (raw ? RAW_FRAME : 0);
+    indexDirtyFrom = min(indexDirtyFrom, bufferIndex);
+    if (Mini_FAT::hasDeduplication())
+        Dedup_Table::add(hash, frame.cluster, needed);
+    return true;
+}
+
+bool File_Handle::storeIndex()
+{
+    size_t clusterSize = Virtual_Disk::getClusterSize();
+    size_t bytes = frames.size() * sizeof(Frame);
+    long long needed = static_cast<long long>((bytes + clusterSize - 1) / clusterSize);
+    if (needed == 0)
+    {
+        if (file.dir_firstCluster != 0)
+            file.extents.freeAll();
+        file.dir_firstCluster = 0;
+        return true;
+    }
+    if (!extendChain(needed))
+        return false;
+    if (needed < file.extents.getClusterCount())
+        file.extents.truncate(static_cast<int>(needed));
+
+    // Index clusters before the one holding the first changed record are on disk already. Every frame past the
+    // old end was stored, so the clusters growTo linked for them are covered too
+    long long firstCluster = indexDirtyFrom / static_cast<long long>(clusterSize / sizeof(Frame));
+    if (firstCluster >= needed)
+        return true;
+    size_t from = static_cast<size_t>(firstCluster) * clusterSize / sizeof(int);
+    span<const int> records(reinterpret_cast<const int*>(frames.data()) + from, bytes / sizeof(int) - from);
+    vector<char> out(records.size() * sizeof(int));
+    Converter::intsToLittleEndian(span<char>(out), records);
+    vector<int> clusters = file.extents.getClusters();
+    Virtual_Disk::writeClusters(vector<int>(clusters.begin() + static_cast<ptrdiff_t>(firstCluster), clusters.end()), span<const char>(out));
+    indexDirtyFrom = LLONG_MAX;
+    return true;
+}
+
+void File_Handle::readIndex(const Directory_Entry& entry, Extent_Map& chain, vector<Frame>& frames)
+{
+    long long frameSize = getFrameSize();
+    size_t count = static_cast<size_t>((entry.dir_fileSize + frameSize - 1) / frameSize);
+    frames.assign(count, Frame{ 0, 0 });
+    chain.load(entry.dir_firstCluster);
+    size_t bytes = min(count * sizeof(Frame), static_cast<size_t>(chain.getClusterCount()) * Virtual_Disk::getClusterSize());
+    if (bytes == 0)
+        return;
+    size_t clusterSize = Virtual_Disk::getClusterSize();
+    Virtual_Disk::readClusters(chain.getClusters((bytes + clusterSize - 1) / clusterSize), span<char>(reinterpret_cast<char*>(frames.data()), bytes));
+    Converter::fromLittleEndian(span<int>(reinterpret_cast<int*>(frames.data()), frames.size() * 2));
+}
+
+bool File_Handle::growTo(long long count)
+{
+    if (!framed)
+        return extendChain(count);
+
+    // The index grows with the file, so an index the disk cannot hold fails the write rather than the close
+    long long perCluster = static_cast<long long>(Virtual_Disk::getClusterSize() / sizeof(Frame));
+    bool linked = extendChain((count + perCluster - 1) / perCluster);
+    long long capacity = static_cast<long long>(file.extents.getClusterCount()) * perCluster;
+    if (min(count, capacity) > static_cast<long long>(frames.size()))
+        frames.resize(static_cast<size_t>(min(count, capacity)), Frame{ 0, 0 });
+    return linked;
+}
+
+bool File_Handle::extendChain(long long count)
+{
+    long long have = extentBase + file.extents.getClusterCount();
+    if (count <= have)
+        return true;
+    if (count - have > Mini_FAT::getAvailableClusters())
+        return false;
+    vector<Mini_FAT::Extent> added = Mini_FAT::allocateClusters(static_cast<int>(count - have));
+    if (added.empty())
+        return false;
+    if (have == 0)
+    {
+        file.extents.assign(added);
+        file.dir_firstCluster = added.front().first;
+    }
+    else
+    {
+        Mini_FAT::setClusterPointer(file.extents.getLastCluster(), added.front().first);
+        file.extents.append(added);
+    }
+    return true;
+}
+
+void File_Handle::findTail()
+{
+    long long clusterSize = static_cast<long long>(buffer.size());
+    long long count = (file.dir_fileSize + clusterSize - 1) / clusterSize;
+    if (file.dir_firstCluster == 0 || count == 0)
+    {
+        file.extents.load(file.dir_firstCluster);
+        return;
+    }
+
+    // A remembered tail is trusted while it still ends the chain, like Extent_Map trusts its ends
+    int tail = -1;
+    auto it = tails.find(file.dir_firstCluster);
+    if (it != tails.end() && it->second.count == count && Mini_FAT::getClusterPointer(file.dir_firstCluster) != 0
+        && Mini_FAT::getClusterPointer(it->second.cluster) == -1)
+    {
+        tail = it->second.cluster;
+    }
+    else
+    {
+        // First append since mount: walk the chain once. A chain longer than the size needs keeps the whole map
+        file.extents.load(file.dir_firstCluster);
+        if (file.extents.getClusterCount() != count)
+            return;
+        tail = file.extents.getLastCluster();
+    }
+    file.extents.assign({ { tail, 1 } });
+    extentBase = count - 1;
+}
+
+void File_Handle::forgetTail(int firstCluster)
+{
+    tails.erase(firstCluster);
+}
+
+void File_Handle::freeFrames(const Directory_Entry& entry)
+{
+    Extent_Map index;
+    vector<Frame> frames;
+    readIndex(entry, index, frames);
+    for (const Frame& frame : frames)
+        releaseFrame(frame.cluster);
+}
+
+void File_Handle::releaseFrame(int cluster)
+{
+    if (cluster == 0 || !Dedup_Table::release(cluster))
+        return;
+    Extent_Map chain;
+    chain.load(cluster);
+    chain.freeAll();
+}
+
+long long File_Handle::getFrameSize()
+{
+    long long clusterSize = static_cast<long long>(Virtual_Disk::getClusterSize());
+    return Mini_FAT::hasCompression() ? clusterSize * FRAME_CLUSTERS : clusterSize;
+}
+
+long long File_Handle::getFrameBytesIn()
+{
+    return frameBytesIn;
+}
+
+long long File_Handle::getFrameBytesOut()
+{
+    return frameBytesOut;
+}
@@ -0,0 +1,223 @@
+#pragma once
+#include "File_Entry.h"
+#include <climits>
+#include <iosfwd>
+#include <span>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+/** An open file on the virtual disk. Reads and writes go through one block-sized buffer at the handle's position,
+    so a file of any size is streamed in constant memory; clusters are linked onto the chain as writes grow the file.
+    The file's entry in its directory (size and first cluster) is brought up to date by close, which the destructor
+    calls for a handle still open.
+
+    A block is one cluster, or for a framed file (on volumes with compression or deduplication) one frame. Each frame
+    is stored in a chain of its own; the file's chain holds the frame index, one {first cluster, stored length} pair
+    of little-endian ints per frame, so any offset is found through its frame without reading the frames before it.
+    With compression a frame is FRAME_CLUSTERS clusters of data compressed with LZ_Codec on its own; one that does
+    not shrink by a cluster is stored as it is, and a file whose frames all are is left as a plain chain. With
+    deduplication a frame whose stored bytes are already on the volume shares their chain (see Dedup_Table). */
+class File_Handle
+{
+public:
+    enum class Mode
+    {
+        Read,   // the file as it is; writes are refused
+        Write,  // the file is emptied when opened
+        Update, // the file as it is; reads and writes anywhere up to its end
+        Append  // writes go to the end of the file; reads and seeks are refused
+    };
+
+    /** Files whose tail cluster is remembered between opens. */
+    static const size_t TAIL_CAPACITY = 256;
+
+    /** Clusters of data in a frame on a volume with compression; without it a frame is one cluster, the unit
+        deduplication shares. */
+    static const int FRAME_CLUSTERS = 16;
+
+    /** Copies of plain files larger than the cluster cache admits move in windows of about BULK_WINDOW_BYTES through
+        the disk's queued transfers, with at most BULK_DEPTH windows queued at once. */
+    static const size_t BULK_WINDOW_BYTES = 256 * 1024;
+    static const size_t BULK_DEPTH = 4;
+
+    File_Handle();
+    ~File_Handle();
+
+    File_Handle(const File_Handle&) = delete;
+    File_Handle& operator=(const File_Handle&) = delete;
+
+    /** Opens the file behind 'entry' in 'parent' at position 0. Fails for a directory entry. */
+    bool open(const Directory_Entry& entry, Directory* parent, Mode mode);
+
+    /** Reads up to out.size() bytes at the position; returns how many were read, 0 at the end of the file. */
+    size_t read(span<char> out);
+
+    /** Writes 'data' at the position, growing the file past its end as needed. Returns how many bytes were written:
+        fewer when the disk fills up or the file reaches the largest size the volume records. */
+    size_t write(span<const char> data);
+
+    /** Reads or writes at 'offset' without moving the position, like pread and pwrite. The offset goes straight to
+        its cluster through the extent map; nothing before it is read. An offset past the end transfers nothing. */
+    size_t readAt(long long offset, span<char> out);
+    size_t writeAt(long long offset, span<const char> data);
+
+    /** Links the clusters a file of 'size' bytes needs ahead of writing it, so a transfer that cannot fit fails
+        before any of it is written. Clusters left unused are released by close. A framed file reserves its index
+        only: the clusters of its frames are taken as each one is stored. */
+    bool reserve(long long size);
+
+    /** Moves the position; false (and no move) past the end of the file. */
+    bool seek(long long offset);
+
+    long long tell() const;
+    long long getSize() const;
+    bool isOpen() const;
+
+    /** Streams the file from the position into 'out', up to 'length' bytes or the end; returns the bytes moved. */
+    long long copyTo(ostream& out, long long length = LLONG_MAX);
+
+    /** Writes everything left in 'in', or in 'source' from its position, at the position; returns the bytes moved.
+        Plain files go window by window through queued bulk transfers (see BULK_WINDOW_BYTES). */
+    long long copyFrom(istream& in);
+    long long copyFrom(File_Handle& source);
+
+    /** The file's entry as the handle last recorded it (by close once it has been called). */
+    const Directory_Entry& getEntry() const;
+
+    /** Writes back the buffered block, releases clusters past the end of the file and records the file's size and
+        first cluster in its directory. */
+    void close();
+
+    /** Forgets the tail remembered for the chain starting at 'firstCluster'; called whenever that chain is freed. */
+    static void forgetTail(int firstCluster);
+
+    /** Releases the frames of the framed file behind 'entry', freeing those no other file shares; its own chain,
+        the index, is freed like any other. */
+    static void freeFrames(const Directory_Entry& entry);
+
+    /** Bytes of frame data compressed since mount, and the bytes they were stored in. */
+    static long long getFrameBytesIn();
+    static long long getFrameBytesOut();
+
+    /** Bytes of data in a frame on the mounted volume, the unit deduplication shares. */
+    static long long getFrameSize();
+
+private:
+    /** A framed file's index record for one frame. */
+    struct Frame
+    {
+        int cluster;    // first cluster of the frame's chain, 0 while it has none
+        int length;     // bytes stored, with RAW_FRAME set when they are not compressed
+    };
+
+    static const int RAW_FRAME = 1 << 30;
+
+    /** One window of a bulk copy: its bytes, where it starts in the file written, the clusters they are read from
+        and written to, whether a transfer queued for it is still running and whether one of them failed. */
+    struct Bulk_Window
+    {
+        vector<char> bytes;
+        size_t length = 0;
+        long long start = 0;
+        vector<int> sourceClusters;
+        vector<int> clusters;
+        bool busy = false;
+        bool failed = false;
+    };
+
+    /** Whether a transfer of 'bytes' bypasses the cluster cache and goes through queued bulk requests. */
+    bool isBulk(long long bytes) const;
+
+    /** Bytes in a bulk window: whole clusters, more than the cache admits and at most one run. */
+    long long getWindowSize() const;
+
+    /** Lists the clusters holding the 'length' bytes at 'start' of a plain file; false past the end of its chain. */
+    bool mapClusters(long long start, long long length, vector<int>& clusters) const;
+
+    /** The bulk paths of copyTo and the copyFroms: whole windows of a plain file, from a cluster-aligned position.
+        Each stops where the rest is better done block by block and returns the bytes it moved. A window the disk
+        fails to read or write sets 'failed' and ends the copy: nothing from a failed read goes out, and a file
+        written ends before the first window that did not reach the disk. */
+    long long streamTo(ostream& out, long long end, bool& failed);
+    long long streamFrom(istream& in, bool& failed);
+    long long streamFrom(File_Handle& source, bool& failed);
+
+    /** Ends a file written in bulk before the first failed window of 'windows', which started at 'from'; returns
+        the bytes of the copy still in the file. */
+    long long cutAtFailure(const vector<Bulk_Window>& windows, long long from);
+
+    /** Bytes a bulk write of 'count' bytes at the position may cover: a cluster it would only partly overwrite
+        keeps its old bytes through the buffer instead, unless nothing of the file lies past it. */
+    size_t getBulkLength(size_t count) const;
+
+    /** Makes the buffer hold the 'index'-th block of the file, reading it from disk only when 'keep' is set
+        (a block about to be overwritten whole, or past the old end, starts zeroed instead). */
+    bool loadBlock(long long index, bool keep);
+
+    /** Writes the buffered block back if it changed. A frame that does not fit cuts the file short where it began. */
+    bool flushBuffer();
+
+    /** Reads and decompresses frame 'index' into the buffer. */
+    bool loadFrame(long long index);
+
+    /** Compresses the buffered frame into a chain of its own, reusing its old chain when the length in clusters
+        is unchanged and no other file shares it, or points it at a chain already holding the same bytes; false
+        when the disk cannot hold it. */
+    bool storeFrame();
+
+    /** Writes the index records from the first changed one on, growing or shrinking the file's chain to fit. */
+    bool storeIndex();
+
+    /** Reads the index of the framed file behind 'entry' through 'chain', the file's own chain. */
+    static void readIndex(const Directory_Entry& entry, Extent_Map& chain, vector<Frame>& frames);
+
+    /** Drops the file's reference to the frame chain at 'cluster', freeing it unless another file shares it. */
+    static void releaseFrame(int cluster);
+
+    /** Makes the file 'count' blocks long: clusters are linked onto the end of the chain, or a framed file's
+        index gains empty frames and the clusters to record them. False if the disk cannot hold the clusters. */
+    bool growTo(long long count);
+
+    /** Links clusters onto the end of the file's chain until it holds 'count'; false if the disk cannot hold them. */
+    bool extendChain(long long count);
+
+    /** Points the extent map at the file's last cluster only, found through the tail cache when it can be, so
+        appending never walks the chain of a file it has seen before. */
+    void findTail();
+
+    struct Tail
+    {
+        int cluster;        // last cluster of the chain
+        long long count;    // clusters in the chain
+    };
+
+    /** Tails of the chains written or appended to lately, by first cluster. */
+    static unordered_map<int, Tail> tails;
+
+    File_Entry file;
+
+    /** Index in the file of the first cluster the extent map describes: 0, or the tail's in append mode. */
+    long long extentBase = 0;
+
+    /** The entry as it was when the file was opened, to find it again in the directory. */
+    Directory_Entry opened;
+
+    Mode mode = Mode::Read;
+    bool openFlag = false;
+    long long position = 0;
+
+    vector<char> buffer;
+    long long bufferIndex = -1;
+    int bufferCluster = -1;
+    bool bufferDirty = false;
+
+    /** Whether the file is stored in frames; its index is kept in 'frames' while it is open. */
+    bool framed = false;
+    vector<Frame> frames;
+    long long indexDirtyFrom = LLONG_MAX;   // first frame whose record changed since open
+    vector<char> packed;                    // a frame as stored on disk
+
+    static long long frameBytesIn;
+    static long long frameBytesOut;
+};
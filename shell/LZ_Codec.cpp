@@ -0,0 +1,168 @@
+#include "LZ_Codec.h"
+#include <cstdint>
+#include <cstring>
+using namespace std;
+
+static const int HASH_BITS = 12;
+static const size_t MIN_MATCH = 4;
+
+// Matches end this far before the input does, and none starts in the last MATCH_START_LIMIT bytes
+static const size_t LAST_LITERALS = 5;
+static const size_t MATCH_START_LIMIT = 12;
+static const size_t MAX_OFFSET = 65535;
+
+static uint32_t read32(const unsigned char* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t hash32(uint32_t value)
+{
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Writes the part of a length past the nibble: 255s, then the remainder
+static void putLength(vector<char>& out, size_t& op, size_t length)
+{
+    while (length >= 255)
+    {
+        out[op++] = static_cast<char>(255);
+        length -= 255;
+    }
+    out[op++] = static_cast<char>(length);
+}
+
+static void putLiterals(vector<char>& out, size_t& op, const unsigned char* literals, size_t count, size_t tokenAt)
+{
+    out[tokenAt] = static_cast<char>((count >= 15 ? 15 : count) << 4);
+    if (count >= 15)
+        putLength(out, op, count - 15);
+    if (count > 0)
+        memcpy(out.data() + op, literals, count);
+    op += count;
+}
+
+size_t LZ_Codec::bound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+size_t LZ_Codec::compress(span<const char> in, vector<char>& out)
+{
+    const unsigned char* src = reinterpret_cast<const unsigned char*>(in.data());
+    size_t size = in.size();
+    out.resize(bound(size));
+    size_t op = 0;
+    size_t anchor = 0;
+
+    if (size > MATCH_START_LIMIT)
+    {
+        vector<int> table(size_t(1) << HASH_BITS, -1);
+        size_t limit = size - MATCH_START_LIMIT;
+        size_t matchLimit = size - LAST_LITERALS;
+        size_t ip = 0;
+        while (ip < limit)
+        {
+            uint32_t sequence = read32(src + ip);
+            uint32_t h = hash32(sequence);
+            int ref = table[h];
+            table[h] = static_cast<int>(ip);
+            if (ref < 0 || ip - static_cast<size_t>(ref) > MAX_OFFSET || read32(src + ref) != sequence)
+            {
+                ip++;
+                continue;
+            }
+
+            size_t length = MIN_MATCH;
+            while (ip + length < matchLimit && src[ref + length] == src[ip + length])
+                length++;
+
+            size_t tokenAt = op++;
+            putLiterals(out, op, src + anchor, ip - anchor, tokenAt);
+            size_t offset = ip - static_cast<size_t>(ref);
+            out[op++] = static_cast<char>(offset & 0xFF);
+            out[op++] = static_cast<char>(offset >> 8);
+            size_t extra = length - MIN_MATCH;
+            out[tokenAt] = static_cast<char>(static_cast<unsigned char>(out[tokenAt]) | (extra >= 15 ? 15 : extra));
+            if (extra >= 15)
+                putLength(out, op, extra - 15);
+
+            ip += length;
+            anchor = ip;
+        }
+    }
+
+    size_t tokenAt = op++;
+    putLiterals(out, op, src + anchor, size - anchor, tokenAt);
+    out.resize(op);
+    return op;
+}
+
+bool LZ_Codec::decompress(span<const char> in, span<char> out)
+{
+    const unsigned char* src = reinterpret_cast<const unsigned char*>(in.data());
+    size_t size = in.size();
+    size_t ip = 0;
+    size_t op = 0;
+    while (ip < size)
+    {
+        unsigned token = src[ip++];
+        size_t literals = token >> 4;
+        if (literals == 15)
+        {
+            unsigned char next;
+            do
+            {
+                if (ip >= size)
+                    return false;
+                next = src[ip++];
+                literals += next;
+            } while (next == 255);
+        }
+        if (literals > size - ip || literals > out.size() - op)
+            return false;
+        if (literals > 0)
+            memcpy(out.data() + op, src + ip, literals);
+        ip += literals;
+        op += literals;
+        if (ip == size)
+            break;
+
+        if (size - ip < 2)
+            return false;
+        size_t offset = src[ip] | (static_cast<size_t>(src[ip + 1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > op)
+            return false;
+        size_t length = token & 15;
+        if (length == 15)
+        {
+            unsigned char next;
+            do
+            {
+                if (ip >= size)
+                    return false;
+                next = src[ip++];
+                length += next;
+            } while (next == 255);
+        }
+        length += MIN_MATCH;
+        if (length > out.size() - op)
+            return false;
+        // A match that starts far enough back is one copy; an overlapping one repeats bytes it produces, so it
+        // goes byte by byte
+        if (offset >= length)
+        {
+            memcpy(out.data() + op, out.data() + op - offset, length);
+            op += length;
+        }
+        else
+        {
+            for (size_t i = 0; i < length; i++, op++)
+                out[op] = out[op - offset];
+        }
+    }
+    return op == out.size();
+}
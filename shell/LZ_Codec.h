@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <span>
+#include <vector>
+using namespace std;
+
+/** Byte-oriented LZ77 compressor for file data, in the block layout of LZ4: each sequence is a token (literal count
+    in the high nibble, match length minus 4 in the low one, 15 meaning more length bytes follow), the literals, and
+    a 2-byte little-endian offset back into the output. The last sequence carries literals only. Matches are found
+    through a single-entry hash table of 4-byte prefixes, which favours speed over ratio. */
+class LZ_Codec
+{
+public:
+    /** Compresses 'in' into 'out' (replacing its content); returns the compressed size. */
+    static size_t compress(span<const char> in, vector<char>& out);
+
+    /** Decompresses 'in' into exactly out.size() bytes; false if the data is malformed or does not fill 'out'. */
+    static bool decompress(span<const char> in, span<char> out);
+
+    /** Largest compressed size of 'size' input bytes. */
+    static size_t bound(size_t size);
+};
@@ -1,26 +1,93 @@
 #include "Mini_FAT.h"
 #include "Converter.h"
-#include "virtual_Disk.h"
+#include "Virtual_Disk.h"
+#include <algorithm>
+#include <bit>
 #include <cstring>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 using namespace std;
 
-int Mini_FAT::FAT[1024];  // FAT array representing cluster state
+// Geometry of the mounted volume
+int Mini_FAT::clusterSize = Mini_FAT::LEGACY_CLUSTER_SIZE;
+int Mini_FAT::clusterCount = Mini_FAT::LEGACY_CLUSTER_COUNT;
+int Mini_FAT::fatStart = 1;
+int Mini_FAT::fatClusters = 4;
+int Mini_FAT::formatVersion = 0;
+int Mini_FAT::features = 0;
+int Mini_FAT::rootCluster = 0;
+int Mini_FAT::dedupTableCluster = 0;
 
-// Initializes the FAT array; sets reserved clusters to -1, free clusters to 0
+vector<vector<int>> Mini_FAT::fatPages;  // FAT pages, loaded on first use
+vector<bool> Mini_FAT::dirtyPages;       // FAT pages changed since the last writeFAT
+long long Mini_FAT::fatClusterWrites = 0;
+
+// Free-cluster bitmap, rebuilt lazily whenever the FAT is replaced wholesale; the count alone can come from the superblock
+vector<uint64_t> Mini_FAT::freeMap;
+long long Mini_FAT::freeCount = 0;
+int Mini_FAT::rotor = 0;
+bool Mini_FAT::freeMapBuilt = false;
+bool Mini_FAT::freeCountKnown = false;
+bool Mini_FAT::freeCountRecorded = false;
+map<int, int> Mini_FAT::freeExtents;
+set<pair<int, int>> Mini_FAT::freeExtentsBySize;
+
+// Superblock layout (little-endian): a magic tag, a format version, then the geometry. Version 2 adds the
+// feature flags and the root directory cluster, then the deduplication table's cluster on volumes with that
+// feature, then the free cluster count plus one as of the last clean unmount (0 while the volume is mounted
+// and changed, or on images written before the count was kept there). An all-zero superblock has no tag and
+// marks an image formatted before the geometry was recorded.
+static const char SUPERBLOCK_MAGIC[8] = { 'M', 'I', 'N', 'I', '_', 'F', 'A', 'T' };
+static const int VERSION_OFFSET = 8;
+static const int CLUSTER_SIZE_OFFSET = 12;
+static const int CLUSTER_COUNT_OFFSET = 16;
+static const int FAT_START_OFFSET = 20;
+static const int FAT_CLUSTERS_OFFSET = 24;
+static const int FEATURES_OFFSET = 28;
+static const int ROOT_CLUSTER_OFFSET = 32;
+static const int DEDUP_TABLE_OFFSET = 36;
+static const int FREE_COUNT_OFFSET = 40;
+static const int SUPERBLOCK_SIZE = 44;
+static_assert(SUPERBLOCK_SIZE <= Mini_FAT::MIN_CLUSTER_SIZE, "superblock must fit the smallest cluster");
+
+// Number of clusters needed to hold one 4-byte FAT entry per cluster
+static int fatClustersFor(int size, int count)
+{
+    return static_cast<int>((static_cast<long long>(count) * 4 + size - 1) / size);
+}
+
+static void putInt(vector<char>& bytes, int offset, int value)
+{
+    vector<char> b = Converter::intToByte(value);
+    copy(b.begin(), b.end(), bytes.begin() + offset);
+}
+
+static int getInt(const vector<char>& bytes, int offset)
+{
+    return Converter::byteToInt(vector<char>(bytes.begin() + offset, bytes.begin() + offset + 4));
+}
+
+// Initializes the FAT; the superblock and the FAT itself are reserved, everything else is free.
+// On a fresh image every page reads back as zeros, so only the pages touched here are ever written.
 void Mini_FAT::initialize_FAT() {
-    for (int i = 0; i < 1024; i++)
+    fatPages.assign(static_cast<size_t>(fatClusters), vector<int>());
+    dirtyPages.assign(static_cast<size_t>(fatClusters), false);
+    freeMapBuilt = false;
+    freeCount = clusterCount - getFirstDataCluster();
+    freeCountKnown = true;
+    entry(0) = -1;
+    markDirty(0);
+    for (int i = fatStart; i < fatStart + fatClusters; i++)
     {
-        if (i == 0 || i == 4)
+        markDirty(i);
+        if (i == fatStart + fatClusters - 1)
         {
-            FAT[i] = -1;
-        }
-        else if (i > 0 && i <= 3)
-        {
-            FAT[i] = i + 1;
+            entry(i) = -1;
         }
         else
         {
-            FAT[i] = 0;
+            entry(i) = i + 1;
         }
     }
 }
@@ -31,49 +98,145 @@ void Mini_FAT::initialize_FAT() {
 void Mini_FAT::printFAT()
 {
     cout << "FAT has the following: ";
-    for (int i = 0; i < 1024; i++)
-        cout << "FAT[" << i << "] = " << Mini_FAT::FAT[i] << endl;
+    for (int i = 0; i < clusterCount; i++)
+        cout << "FAT[" << i << "] = " << entry(i) << endl;
 }
 
-// Creates a superblock (vector) by copying the FAT array into bytes
+// Creates a superblock (vector) recording the geometry of the volume
 vector<char> Mini_FAT::createSuperBlock()
 {
-    vector<char> superBlock(1024, 0);  // Create vector with space for 1024 FAT entries
+    vector<char> superBlock(static_cast<size_t>(clusterSize), 0);
+    copy(begin(SUPERBLOCK_MAGIC), end(SUPERBLOCK_MAGIC), superBlock.begin());
+    putInt(superBlock, VERSION_OFFSET, formatVersion);
+    putInt(superBlock, CLUSTER_SIZE_OFFSET, clusterSize);
+    putInt(superBlock, CLUSTER_COUNT_OFFSET, clusterCount);
+    putInt(superBlock, FAT_START_OFFSET, fatStart);
+    putInt(superBlock, FAT_CLUSTERS_OFFSET, fatClusters);
+    putInt(superBlock, FEATURES_OFFSET, features);
+    putInt(superBlock, ROOT_CLUSTER_OFFSET, rootCluster);
+    putInt(superBlock, DEDUP_TABLE_OFFSET, dedupTableCluster);
+    putInt(superBlock, FREE_COUNT_OFFSET, freeCountRecorded ? static_cast<int>(freeCount) + 1 : 0);
     return superBlock;
 }
 
-// Writes the FAT array to the virtual disk by splitting it into clusters
+// Reads the geometry from cluster 0; the header fits in the smallest cluster, so it is readable whatever the current cluster size
+void Mini_FAT::readSuperBlock()
+{
+    vector<char> header(MIN_CLUSTER_SIZE);
+    Virtual_Disk::readCluster(0, span<char>(header));
+
+    formatVersion = 0;
+    features = 0;
+    rootCluster = 0;
+    dedupTableCluster = 0;
+    if (!equal(begin(SUPERBLOCK_MAGIC), end(SUPERBLOCK_MAGIC), header.begin()))
+    {
+        setGeometry(LEGACY_CLUSTER_SIZE, LEGACY_CLUSTER_COUNT);
+        return;
+    }
+
+    int version = getInt(header, VERSION_OFFSET);
+    int size = getInt(header, CLUSTER_SIZE_OFFSET);
+    int count = getInt(header, CLUSTER_COUNT_OFFSET);
+    if (version < 1 || version > FORMAT_VERSION || !isValidGeometry(size, count) ||
+        getInt(header, FAT_START_OFFSET) != 1 || getInt(header, FAT_CLUSTERS_OFFSET) != fatClustersFor(size, count))
+    {
+        cout << "Error: The superblock of the virtual disk is damaged; assuming the legacy layout.\n";
+        setGeometry(LEGACY_CLUSTER_SIZE, LEGACY_CLUSTER_COUNT);
+        return;
+    }
+    setGeometry(size, count);
+    formatVersion = version;
+
+    // Version 1 images predate the feature flags and the root pointer: their sizes are 32-bit
+    if (version >= 2)
+    {
+        features = getInt(header, FEATURES_OFFSET);
+        int root = getInt(header, ROOT_CLUSTER_OFFSET);
+        if (root >= getFirstDataCluster() && root < clusterCount)
+            rootCluster = root;
+        int table = getInt(header, DEDUP_TABLE_OFFSET);
+        if (hasDeduplication() && table >= getFirstDataCluster() && table < clusterCount)
+            dedupTableCluster = table;
+
+        // A recorded free count spares the first free-space query a read of the whole FAT
+        int recorded = getInt(header, FREE_COUNT_OFFSET);
+        if (recorded > 0 && recorded - 1 <= clusterCount - getFirstDataCluster())
+        {
+            freeCount = recorded - 1;
+            freeCountKnown = true;
+            freeCountRecorded = true;
+        }
+    }
+}
+
+// Writes the dirty FAT pages to the virtual disk; pages in adjacent FAT clusters leave as one run
 void Mini_FAT::writeFAT()
 {
-    vector<char> FATBYTES = Converter::intArrayToByteArray(Mini_FAT::FAT, 1024);
-    vector<vector<char>> ls = Converter::splitBytes(FATBYTES);
-    for (int i = 0; i < ls.size(); i++)
+    vector<int> clusters;
+    for (size_t page = 0; page < fatPages.size(); page++)
     {
-        Virtual_Disk::writeCluster(ls[i], i + 1);
+        if (dirtyPages[page])
+            clusters.push_back(fatStart + static_cast<int>(page));
     }
+    if (clusters.empty())
+        return;
+
+    // Each page is stored with one bulk little-endian copy into its slot of a single staging buffer
+    vector<char> FATBYTES(clusters.size() * static_cast<size_t>(clusterSize));
+    for (size_t i = 0; i < clusters.size(); i++)
+    {
+        size_t page = static_cast<size_t>(clusters[i] - fatStart);
+        Converter::intsToLittleEndian(span<char>(FATBYTES).subspan(i * clusterSize, clusterSize), fatPages[page]);
+        dirtyPages[page] = false;
+    }
+    Virtual_Disk::writeClusters(clusters, FATBYTES);
+    fatClusterWrites += static_cast<long long>(clusters.size());
 }
-// Reads the FAT array from the virtual disk (clusters 1-4) and reconstructs it
+// Drops the loaded pages; entries are read back from the FAT clusters (the ones after the superblock) when used
 void Mini_FAT::readFAT()
 {
-    vector<char> ls;
-    for (int i = 1; i <= 4; i++)
+    fatPages.assign(static_cast<size_t>(fatClusters), vector<int>());
+    dirtyPages.assign(static_cast<size_t>(fatClusters), false);
+    freeMapBuilt = false;
+}
+
+// Sets the FAT array with a provided array of integers
+void Mini_FAT::setFAT(const int* fat_array) {
+    for (int i = 0; i < clusterCount; i++)
     {
-        vector<char> b = Virtual_Disk::readCluster(i);
-        ls.insert(ls.end(), b.begin(), b.end());
+        entry(i) = fat_array[i];  // Copy input FAT array to the FAT array
+        markDirty(i);
     }
-    Converter::byteArrayToIntArray(Mini_FAT::FAT, ls);
+    freeMapBuilt = false;
+    freeCountKnown = false;
+    forgetRecordedFreeCount();
 }
 
-// Sets the FAT array with a provided array of integers
-void Mini_FAT::setFAT(const int fat_array[1024]) {
-    memcpy(FAT, fat_array, 1024 * sizeof(int));  // Copy input FAT array to the FAT array
+// Checks a requested geometry: a power-of-two cluster size in range, and room for at least one data cluster
+bool Mini_FAT::isValidGeometry(int size, int count)
+{
+    if (size < MIN_CLUSTER_SIZE || size > MAX_CLUSTER_SIZE || (size & (size - 1)) != 0)
+        return false;
+    return count > 1 + fatClustersFor(size, count);
 }
 
 // Initializes or opens the file system. If the disk file doesn't exist, it creates it
-void Mini_FAT::initialize_Or_Open_FileSystem( string name) {
-    Virtual_Disk::createOrOpenDisk(name);
+void Mini_FAT::initialize_Or_Open_FileSystem( string name, Virtual_Disk::Mode mode, int newClusterSize, int newClusterCount, int newFeatures) {
+    Virtual_Disk::createOrOpenDisk(name, mode);
     if (Virtual_Disk::isNew())
     {
+        if (!isValidGeometry(newClusterSize, newClusterCount))
+        {
+            cout << "Error: Unsupported disk geometry; formatting with " << LEGACY_CLUSTER_COUNT << " clusters of " << LEGACY_CLUSTER_SIZE << " bytes.\n";
+            newClusterSize = LEGACY_CLUSTER_SIZE;
+            newClusterCount = LEGACY_CLUSTER_COUNT;
+        }
+        setGeometry(newClusterSize, newClusterCount);
+        formatVersion = FORMAT_VERSION;
+        features = FEATURE_LARGE_FILES | FEATURE_TREE_DIRECTORIES | FEATURE_DELETED_SLOTS | newFeatures;
+        rootCluster = 0;
+        dedupTableCluster = 0;
         vector<char> superBlock = Mini_FAT::createSuperBlock();
         Virtual_Disk::writeCluster(superBlock, 0);
         Mini_FAT::initialize_FAT();
@@ -81,77 +244,400 @@ void Mini_FAT::initialize_Or_Open_FileSystem( string name) {
     }
     else
     {
+        Mini_FAT::readSuperBlock();
         Mini_FAT::readFAT();
     }
 }
 
-// Returns the number of free clusters in the FAT array
+// Returns the next free cluster, searching from the rotor to the end and then from the start (next-fit)
 int Mini_FAT::getAvailableCluster()
 {
-    for (int i = 0; i < 1024; i++)
-    {
-        if (Mini_FAT::FAT[i] == 0)
-            return i;
-    }
-    return -1;//our disk is full
+    if (!freeMapBuilt)
+        buildFreeMap();
+    if (freeCount == 0)
+        return -1;//our disk is full
+    int cluster = findFree(rotor, clusterCount);
+    if (cluster == -1)
+        cluster = findFree(0, rotor);
+    return cluster;
 }
 
-//Returns the index of the first free cluster in the FAT array
+// Returns the number of free clusters, kept as a running count
 int Mini_FAT::getAvailableClusters()
 {
-    int counter = 0;
-    for (int i = 0; i < 1024; i++)
+    if (!freeCountKnown)
+        buildFreeMap();
+    return static_cast<int>(freeCount);
+}
+
+
+// Sets the pointer (next cluster, -1 for end of chain, 0 for free) for a given cluster index in the FAT
+void Mini_FAT::setClusterPointer(int clusterIndex, int status)
+{
+    if (clusterIndex < 0 || clusterIndex >= clusterCount || status < -1 || status >= clusterCount)
+        return;
+    int& slot = entry(clusterIndex);
+    if ((slot == 0) != (status == 0))
     {
-        if (Mini_FAT::FAT[i] == 0)
-            counter++;
+        // The count is kept even before the bitmap exists, when it came from the superblock
+        forgetRecordedFreeCount();
+        if (freeCountKnown)
+            freeCount += status == 0 ? 1 : -1;
     }
-    return counter;
+    if (freeMapBuilt && (slot == 0) != (status == 0))
+    {
+        uint64_t bit = uint64_t(1) << (clusterIndex % 64);
+        if (status == 0)
+        {
+            freeMap[clusterIndex / 64] |= bit;
+            addFreeCluster(clusterIndex);
+        }
+        else
+        {
+            // Allocations move the rotor on, so the next search starts where this one left off
+            freeMap[clusterIndex / 64] &= ~bit;
+            removeFreeCluster(clusterIndex);
+            rotor = clusterIndex + 1 < clusterCount ? clusterIndex + 1 : 0;
+        }
+    }
+    if (slot != status)
+        markDirty(clusterIndex);
+    slot = status;
 }
 
+// Picks the runs for a chain of 'count' clusters, then links them; each link updates the bitmap and the free runs
+vector<Mini_FAT::Extent> Mini_FAT::allocateClusters(int count)
+{
+    vector<Extent> extents;
+    if (!freeMapBuilt)
+        buildFreeMap();
+    if (count <= 0 || count > freeCount)
+        return extents;
 
-// Sets the pointer (next cluster) for a given cluster index in the FAT
-void Mini_FAT::setClusterPointer(int clusterIndex, int status)
+    auto fit = freeExtentsBySize.lower_bound({ count, 0 });
+    if (fit != freeExtentsBySize.end())
+    {
+        extents.push_back({ fit->second, count });
+    }
+    else
+    {
+        // No single run is large enough: take the largest ones so the chain has as few runs as possible
+        int remaining = count;
+        for (auto it = freeExtentsBySize.rbegin(); it != freeExtentsBySize.rend() && remaining > 0; ++it)
+        {
+            int length = min(it->first, remaining);
+            extents.push_back({ it->second, length });
+            remaining -= length;
+        }
+    }
+
+    int previous = -1;
+    for (const Extent& extent : extents)
+    {
+        for (int cluster = extent.first; cluster < extent.first + extent.length; cluster++)
+        {
+            setClusterPointer(cluster, -1);
+            if (previous != -1)
+                setClusterPointer(previous, cluster);
+            previous = cluster;
+        }
+    }
+    return extents;
+}
+
+vector<int> Mini_FAT::getExtentClusters(const vector<Extent>& extents)
 {
-    if (clusterIndex >= 0 && clusterIndex < 1024 && status >= 0 && status < 1024)
-        Mini_FAT::FAT[clusterIndex] = status;
+    vector<int> clusters;
+    for (const Extent& extent : extents)
+    {
+        for (int cluster = extent.first; cluster < extent.first + extent.length; cluster++)
+            clusters.push_back(cluster);
+    }
+    return clusters;
 }
 
 // Retrieves the pointer (next cluster) for a given cluster index in the FAT
 int Mini_FAT::getClusterPointer(int clusterIndex)
 {
-    if (clusterIndex >= 0 && clusterIndex < 1024)
-        return Mini_FAT::FAT[clusterIndex];
+    if (clusterIndex >= 0 && clusterIndex < clusterCount)
+        return entry(clusterIndex);
     else
         return -1;
 }
 
+// Collects the clusters of a chain so callers can transfer them in one vectored call
+vector<int> Mini_FAT::getClusterChain(int firstCluster, size_t limit)
+{
+    vector<int> chain;
+    limit = min(limit, static_cast<size_t>(clusterCount));
+    int cluster = firstCluster;
+    while (cluster != -1 && chain.size() < limit)
+    {
+        chain.push_back(cluster);
+        cluster = Mini_FAT::getClusterPointer(cluster);
+    }
+    return chain;
+}
+
 // Returns the total free space available on the disk (in bytes)
-int Mini_FAT::getFreeSize()
+long long Mini_FAT::getFreeSize()
 {
-    return Mini_FAT::getAvailableClusters() * 1024;
+    return static_cast<long long>(Mini_FAT::getAvailableClusters()) * clusterSize;
 }
 
+// Records the free count in the superblock on the way out, so the next mount can answer free-space queries
+// without reading the FAT; a volume whose count was never needed this session is scanned once here instead
 void Mini_FAT::CloseTheSystem()
 {
     Mini_FAT::writeFAT();
+    if (formatVersion >= 2 && !freeCountRecorded)
+    {
+        if (!freeCountKnown)
+            buildFreeMap();
+        freeCountRecorded = true;
+        Virtual_Disk::writeCluster(createSuperBlock(), 0);
+    }
+    Virtual_Disk::sync(true);
     Virtual_Disk::closeDisk();
 }
 
 
 long long Mini_FAT::getTotalClusters() {
-    return  1024;
+    return clusterCount;
 }
 
 long long Mini_FAT::getFreeClusters() {
-    long long count = 0;
-    for (long long i = 0; i < getTotalClusters(); ++i) {
-        if (FAT[i] == 0) { // Assuming 0 indicates a free cluster
-            count++;
+    return getAvailableClusters();
+}
+
+long long Mini_FAT::getClusterSize() {
+    return clusterSize;
+}
+
+long long Mini_FAT::getFATClusterWrites() {
+    return fatClusterWrites;
+}
+
+int Mini_FAT::getFormatVersion() {
+    return formatVersion;
+}
+
+bool Mini_FAT::hasLargeFiles() {
+    return (features & FEATURE_LARGE_FILES) != 0;
+}
+
+bool Mini_FAT::hasTreeDirectories() {
+    return (features & FEATURE_TREE_DIRECTORIES) != 0;
+}
+
+bool Mini_FAT::hasDeletedSlots() {
+    return (features & FEATURE_DELETED_SLOTS) != 0;
+}
+
+bool Mini_FAT::hasCompression() {
+    return (features & FEATURE_COMPRESSION) != 0;
+}
+
+bool Mini_FAT::hasDeduplication() {
+    return (features & FEATURE_DEDUPLICATION) != 0;
+}
+
+int Mini_FAT::getRootCluster() {
+    return rootCluster;
+}
+
+void Mini_FAT::setRootCluster(int cluster) {
+    if (cluster == rootCluster)
+        return;
+    rootCluster = cluster;
+    if (formatVersion >= 2)
+        Virtual_Disk::writeCluster(createSuperBlock(), 0);
+}
+
+int Mini_FAT::getDedupTableCluster() {
+    return dedupTableCluster;
+}
+
+void Mini_FAT::setDedupTableCluster(int cluster) {
+    if (cluster == dedupTableCluster)
+        return;
+    dedupTableCluster = cluster;
+    Virtual_Disk::writeCluster(createSuperBlock(), 0);
+}
+
+int Mini_FAT::getFATStart() {
+    return fatStart;
+}
+
+int Mini_FAT::getFATClusters() {
+    return fatClusters;
+}
+
+int Mini_FAT::getFirstDataCluster() {
+    return fatStart + fatClusters;
+}
+
+// Records the layout and tells the disk how large its clusters are
+void Mini_FAT::setGeometry(int size, int count) {
+    clusterSize = size;
+    clusterCount = count;
+    fatStart = 1;
+    fatClusters = fatClustersFor(size, count);
+    fatPages.assign(static_cast<size_t>(fatClusters), vector<int>());
+    dirtyPages.assign(static_cast<size_t>(fatClusters), false);
+    freeMapBuilt = false;
+    freeCountKnown = false;
+    freeCountRecorded = false;
+    Virtual_Disk::setClusterSize(static_cast<size_t>(size));
+}
+
+void Mini_FAT::markDirty(int clusterIndex) {
+    dirtyPages[static_cast<size_t>(clusterIndex) / (static_cast<size_t>(clusterSize) / 4)] = true;
+}
+
+int& Mini_FAT::entry(int clusterIndex) {
+    size_t entriesPerPage = static_cast<size_t>(clusterSize) / 4;
+    size_t page = static_cast<size_t>(clusterIndex) / entriesPerPage;
+    if (fatPages[page].empty())
+    {
+        // The cluster is read straight into the page, then put in host order where that differs
+        vector<int>& entries = fatPages[page];
+        entries.resize(entriesPerPage);
+        Virtual_Disk::readCluster(fatStart + static_cast<int>(page), span<char>(reinterpret_cast<char*>(entries.data()), static_cast<size_t>(clusterSize)));
+        Converter::fromLittleEndian(entries);
+    }
+    return fatPages[page][static_cast<size_t>(clusterIndex) % entriesPerPage];
+}
+void Mini_FAT::buildFreeMap() {
+    // Pages still on disk are read in one call so the adjacent FAT clusters go out as a single run
+    size_t entriesPerPage = static_cast<size_t>(clusterSize) / 4;
+    vector<int> missing;
+    for (size_t page = 0; page < fatPages.size(); page++)
+    {
+        if (fatPages[page].empty())
+            missing.push_back(fatStart + static_cast<int>(page));
+    }
+    if (!missing.empty())
+    {
+        vector<char> bytes(missing.size() * static_cast<size_t>(clusterSize));
+        Virtual_Disk::readClusters(missing, span<char>(bytes));
+        for (size_t i = 0; i < missing.size(); i++)
+        {
+            vector<int>& page = fatPages[static_cast<size_t>(missing[i] - fatStart)];
+            page.resize(entriesPerPage);
+            memcpy(page.data(), bytes.data() + i * clusterSize, static_cast<size_t>(clusterSize));
+            Converter::fromLittleEndian(page);
         }
     }
-    return count;
+
+    freeMap.assign((static_cast<size_t>(clusterCount) + 63) / 64, 0);
+    freeCount = 0;
+    freeExtents.clear();
+    freeExtentsBySize.clear();
+    int runStart = -1;
+    for (int i = 0; i <= clusterCount; i++)
+    {
+        bool isFree = i < clusterCount && fatPages[i / entriesPerPage][i % entriesPerPage] == 0;
+        if (isFree)
+        {
+            freeMap[i / 64] |= uint64_t(1) << (i % 64);
+            freeCount++;
+            if (runStart == -1)
+                runStart = i;
+        }
+        else if (runStart != -1)
+        {
+            freeExtents[runStart] = i - runStart;
+            freeExtentsBySize.insert({ i - runStart, runStart });
+            runStart = -1;
+        }
+    }
+    rotor = min(rotor, clusterCount - 1);
+    freeMapBuilt = true;
+    freeCountKnown = true;
 }
 
-long long Mini_FAT::getClusterSize() {
-    return 1024; // Example cluster size: 4KB
-}
\ No newline at end of file
+// The first change to free space after mount clears the recorded count before any FAT page reaches the disk,
+// so a session that ends without unmounting leaves no stale count behind
+void Mini_FAT::forgetRecordedFreeCount() {
+    if (!freeCountRecorded)
+        return;
+    freeCountRecorded = false;
+    Virtual_Disk::writeCluster(createSuperBlock(), 0);
+}
+
+int Mini_FAT::findFree(int from, int to) {
+    if (from >= to)
+        return -1;
+    size_t word = static_cast<size_t>(from) / 64;
+    size_t lastWord = (static_cast<size_t>(to) + 63) / 64;
+
+    // The first word may hold clusters before 'from'; mask them off
+    uint64_t bits = freeMap[word] & (~uint64_t(0) << (from % 64));
+    while (bits == 0)
+    {
+        if (++word >= lastWord)
+            return -1;
+#ifdef __AVX2__
+        // Skip fully allocated stretches four words at a time
+        while (word + 4 <= lastWord)
+        {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&freeMap[word]));
+            if (!_mm256_testz_si256(block, block))
+                break;
+            word += 4;
+        }
+        if (word >= lastWord)
+            return -1;
+#endif
+        bits = freeMap[word];
+    }
+    int cluster = static_cast<int>(word * 64) + countr_zero(bits);
+    return cluster < to ? cluster : -1;
+}
+
+void Mini_FAT::addFreeCluster(int cluster) {
+    int first = cluster;
+    int length = 1;
+    auto after = freeExtents.find(cluster + 1);
+    if (after != freeExtents.end())
+    {
+        length += after->second;
+        freeExtentsBySize.erase({ after->second, after->first });
+        freeExtents.erase(after);
+    }
+    auto before = freeExtents.lower_bound(cluster);
+    if (before != freeExtents.begin() && prev(before)->first + prev(before)->second == cluster)
+    {
+        --before;
+        first = before->first;
+        length += before->second;
+        freeExtentsBySize.erase({ before->second, before->first });
+        freeExtents.erase(before);
+    }
+    freeExtents[first] = length;
+    freeExtentsBySize.insert({ length, first });
+}
+
+void Mini_FAT::removeFreeCluster(int cluster) {
+    auto run = freeExtents.upper_bound(cluster);
+    if (run == freeExtents.begin())
+        return;
+    --run;
+    int first = run->first;
+    int length = run->second;
+    if (cluster >= first + length)
+        return;
+    freeExtentsBySize.erase({ length, first });
+    freeExtents.erase(run);
+    if (cluster > first)
+    {
+        freeExtents[first] = cluster - first;
+        freeExtentsBySize.insert({ cluster - first, first });
+    }
+    if (cluster + 1 < first + length)
+    {
+        freeExtents[cluster + 1] = first + length - cluster - 1;
+        freeExtentsBySize.insert({ first + length - cluster - 1, cluster + 1 });
+    }
+}
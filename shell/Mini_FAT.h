@@ -1,49 +1,106 @@
 #pragma once
 #include "Virtual_Disk.h"
+#include <cstdint>
+#include <map>
+#include <set>
 #include <vector>
 #include <string>
 using namespace std;
 class Mini_FAT
 {
 public:
-    /** FAT array representing cluster states: -1 for EOF, 0 for free, and positive values for next cluster in chain. */
-    static int FAT[1024];
+    /** Geometry assumed for images whose superblock carries none (formatted before it was recorded). */
+    static const int LEGACY_CLUSTER_SIZE = 1024;
+    static const int LEGACY_CLUSTER_COUNT = 1024;
+
+    /** Range of cluster sizes a volume can be formatted with (powers of two). */
+    static const int MIN_CLUSTER_SIZE = 512;
+    static const int MAX_CLUSTER_SIZE = 64 * 1024;
+
+    /** Superblock format written by this version: 2 adds the feature flags and the root directory cluster. */
+    static const int FORMAT_VERSION = 2;
+
+    /** Feature flag: directory entries carry 64-bit file sizes (the high half in their reserved bytes). */
+    static const int FEATURE_LARGE_FILES = 1;
+
+    /** Feature flag: directories past a size threshold are stored as B+trees. */
+    static const int FEATURE_TREE_DIRECTORIES = 2;
+
+    /** Feature flag: removed directory entries leave a deleted marker in their slot instead of a rewritten directory. */
+    static const int FEATURE_DELETED_SLOTS = 4;
+
+    /** Feature flag: files written on this volume are stored compressed, in frames indexed from their first cluster. */
+    static const int FEATURE_COMPRESSION = 8;
+
+    /** Feature flag: file frames with identical content share one chain, counted in Dedup_Table. */
+    static const int FEATURE_DEDUPLICATION = 16;
 
     /** Initializes the FAT, marking reserved clusters as -1 and others as free (0). */
     static void initialize_FAT();
 
-    /** Creates the superblock as a byte vector by serializing the FAT. */
+    /** Creates the superblock as a byte vector recording the geometry of the volume. */
     static vector<char> createSuperBlock();
 
-    /** Writes the FAT to the virtual disk by splitting into clusters. */
+    /** Reads the geometry, format version and features from the superblock; images without one get the legacy 1 MiB layout. */
+    static void readSuperBlock();
+
+    /** Writes the FAT pages changed since the last call back to the virtual disk, adjacent ones as a single run.
+        Called at the sync points: the end of each shell command and unmount. */
     static void writeFAT();
 
-    /** Reads the FAT from the virtual disk and reconstructs it. */
+    /** Forgets the loaded FAT pages; each one is read from the virtual disk again the first time one of its entries is used. */
     static void readFAT();
 
     /** Prints the FAT contents for debugging purposes. */
     static void printFAT();
 
-    /** Sets the FAT array with the provided data. */
-    static void setFAT(const int fat_arr[1024]);
+    /** Sets the FAT array with the provided data (one entry per cluster). */
+    static void setFAT(const int* fat_arr);
+
+    /** Initializes or opens the file system, creating or reading from the virtual disk (memory-mapped unless told otherwise).
+        A new disk is formatted with 'newClusterCount' clusters of 'newClusterSize' bytes and the optional features in
+        'newFeatures' on top of the standard ones; an existing one keeps its own geometry and features. */
+    static void initialize_Or_Open_FileSystem( string name, Virtual_Disk::Mode mode = Virtual_Disk::Mode::Mapped,
+        int newClusterSize = LEGACY_CLUSTER_SIZE, int newClusterCount = LEGACY_CLUSTER_COUNT, int newFeatures = 0);
 
-    /** Initializes or opens the file system, creating or reading from the virtual disk. */
-    static void initialize_Or_Open_FileSystem( string name);
+    /** Checks that a volume of 'count' clusters of 'size' bytes can be formatted. */
+    static bool isValidGeometry(int size, int count);
 
-    /** Returns the number of free clusters in the FAT. */
+    /** Returns the number of free clusters in the FAT (a running count, no scan once known; right after mount it is the
+        one the superblock recorded at the last clean unmount, and the FAT is read whole only on volumes without one). */
     static int getAvailableClusters();
 
-    /** Returns the index of the first available (free) cluster. */
+    /** Returns the next free cluster at or after the allocation rotor, wrapping around once; -1 when the disk is full.
+        Asking twice without allocating returns the same cluster. */
     static int getAvailableCluster();
 
+    /** A run of adjacent clusters. */
+    struct Extent
+    {
+        int first;
+        int length;
+    };
+
+    /** Allocates 'count' clusters linked as one chain (the last marked -1). The smallest free run that holds them all is used
+        (best fit); failing that, the largest runs are taken first. Returns the runs in chain order, or nothing (allocating
+        nothing) when fewer than 'count' clusters are free. */
+    static vector<Extent> allocateClusters(int count);
+
+    /** Lists the clusters of 'extents' in order. */
+    static vector<int> getExtentClusters(const vector<Extent>& extents);
+
     /** Sets the pointer for a cluster in the FAT (next cluster, EOF, or free). */
     static void setClusterPointer(int clusterIndex, int pointer);
 
     /** Gets the pointer value for a specific cluster in the FAT. */
     static int getClusterPointer(int clusterIndex);
 
+    /** Follows the chain from 'firstCluster' and returns its clusters in order, stopping after 'limit' clusters
+        (and never following more clusters than the volume has). */
+    static vector<int> getClusterChain(int firstCluster, size_t limit = SIZE_MAX);
+
     /** Returns the total free space on the disk in bytes. */
-    static int getFreeSize();
+    static long long getFreeSize();
 
     static void CloseTheSystem();
 
@@ -53,6 +110,103 @@ public:
 
     static long long getClusterSize();
 
+    /** Number of FAT clusters written to the virtual disk since mount. */
+    static long long getFATClusterWrites();
+
+    /** Version of the superblock format the mounted volume was created with (0 for a legacy image). */
+    static int getFormatVersion();
+
+    /** Whether file sizes above 2 GiB can be recorded on this volume. */
+    static bool hasLargeFiles();
+
+    /** Whether large directories may be stored as B+trees on this volume. */
+    static bool hasTreeDirectories();
+
+    /** Whether flat directories may contain deleted slots on this volume. */
+    static bool hasDeletedSlots();
+
+    /** Whether files written on this volume are compressed. */
+    static bool hasCompression();
+
+    /** Whether identical file frames share their clusters on this volume. */
+    static bool hasDeduplication();
+
+    /** First cluster of the root directory (0 while it is empty). */
+    static int getRootCluster();
+
+    /** Records where the root directory starts; the superblock is rewritten on volumes whose format has the field. */
+    static void setRootCluster(int cluster);
+
+    /** First cluster of the deduplication table (0 while it has none), recorded in the superblock like the root. */
+    static int getDedupTableCluster();
+    static void setDedupTableCluster(int cluster);
+
+    /** First cluster of the FAT and the number of clusters it occupies. */
+    static int getFATStart();
+    static int getFATClusters();
+
+    /** First cluster available to directories and files (just past the FAT). */
+    static int getFirstDataCluster();
+
 
 private:
+    /** Geometry of the mounted volume, as recorded in the superblock. */
+    static int clusterSize;
+    static int clusterCount;
+    static int fatStart;
+    static int fatClusters;
+
+    /** Format version, feature flags, and root directory and deduplication table clusters of the mounted volume. */
+    static int formatVersion;
+    static int features;
+    static int rootCluster;
+    static int dedupTableCluster;
+
+    /** FAT entries (-1 for EOF, 0 for free, positive for the next cluster in the chain), one cluster of the FAT per page.
+        A page is empty until one of its entries is first used, so mounting never reads the whole table. */
+    static vector<vector<int>> fatPages;
+
+    /** Returns the FAT entry of a cluster, reading its page from the virtual disk on first use. */
+    static int& entry(int clusterIndex);
+
+    /** Pages changed since the last writeFAT, and the FAT cluster writes made so far. */
+    static vector<bool> dirtyPages;
+    static long long fatClusterWrites;
+
+    /** Marks the page holding a cluster's entry as needing a write. */
+    static void markDirty(int clusterIndex);
+
+    /** Free-cluster bitmap (bit set = free), the number of free clusters and the next-fit rotor where searches start.
+        Built on the first allocation (or free-space query, when the count is not known) after the FAT changes wholesale,
+        then kept up to date by setClusterPointer. */
+    static vector<uint64_t> freeMap;
+    static long long freeCount;
+    static int rotor;
+    static bool freeMapBuilt;
+
+    /** Whether freeCount is right without the bitmap (taken from the superblock at mount), and whether the superblock
+        on disk holds that count; it stops holding it at the first change to free space until the next clean unmount. */
+    static bool freeCountKnown;
+    static bool freeCountRecorded;
+
+    /** Clears the free count recorded in the superblock, if any, before free space changes. */
+    static void forgetRecordedFreeCount();
+
+    /** Free runs indexed by first cluster (to find neighbours) and by (length, first) for best-fit searches.
+        Built and maintained alongside the bitmap. */
+    static map<int, int> freeExtents;
+    static set<pair<int, int>> freeExtentsBySize;
+
+    /** Updates the free-run index when one cluster becomes free (merging with its neighbours) or used (splitting its run). */
+    static void addFreeCluster(int cluster);
+    static void removeFreeCluster(int cluster);
+
+    /** Reads every FAT page not loaded yet (in one vectored call) and rebuilds the bitmap, the free count and the free runs from them. */
+    static void buildFreeMap();
+
+    /** Returns the first free cluster in [from, to), or -1. */
+    static int findFree(int from, int to);
+
+    /** Lays out a volume: the superblock in cluster 0, then the FAT, then the data clusters. */
+    static void setGeometry(int size, int count);
 };
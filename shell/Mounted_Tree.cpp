@@ -0,0 +1,186 @@
+#include "Mounted_Tree.h"
+#include "Directory.h"
+#include "File_Entry.h"
+#include "Mini_FAT.h"
+#include <algorithm>
+#include <unordered_map>
+using namespace std;
+
+struct Mounted_Tree::Node
+{
+    alignas(Directory) alignas(File_Entry) unsigned char bytes[max(sizeof(Directory), sizeof(File_Entry))];
+};
+
+vector<unique_ptr<Mounted_Tree::Node[]>> Mounted_Tree::slabs;
+vector<void*> Mounted_Tree::freeNodes;
+vector<Directory*> Mounted_Tree::directories;
+vector<File_Entry*> Mounted_Tree::files;
+Directory* Mounted_Tree::root = nullptr;
+size_t Mounted_Tree::budget = Mounted_Tree::DEFAULT_BUDGET;
+long long Mounted_Tree::clock = 0;
+long long Mounted_Tree::evictions = 0;
+
+Directory* Mounted_Tree::mount()
+{
+    root = createDirectory("C:", 0x10, Mini_FAT::getRootCluster(), nullptr);
+    root->readDirectory();
+    return root;
+}
+
+void Mounted_Tree::unmount()
+{
+    // Nodes only point at each other, so they can go in any order once their changes are on disk
+    Directory::flushAll();
+    for (File_Entry* file : files)
+        file->~File_Entry();
+    for (Directory* dir : directories)
+        dir->~Directory();
+    files.clear();
+    directories.clear();
+    freeNodes.clear();
+    slabs.clear();
+    root = nullptr;
+}
+
+Directory* Mounted_Tree::getRoot()
+{
+    return root;
+}
+
+Directory* Mounted_Tree::createDirectory(const string& name, char attr, int firstCluster, Directory* parent)
+{
+    Directory* dir = new (allocate()) Directory(name, attr, firstCluster, parent);
+    directories.push_back(dir);
+    touch(dir);
+    return dir;
+}
+
+File_Entry* Mounted_Tree::createFile(const Directory_Entry& entry, Directory* parent)
+{
+    File_Entry* file = new (allocate()) File_Entry(entry, parent);
+    files.push_back(file);
+    return file;
+}
+
+void Mounted_Tree::releaseDirectory(Directory* dir)
+{
+    auto it = find(directories.begin(), directories.end(), dir);
+    if (it == directories.end())
+        return;
+    directories.erase(it);
+    if (dir == root)
+        root = nullptr;
+    dir->~Directory();
+    deallocate(dir);
+}
+
+void Mounted_Tree::touch(Directory* dir)
+{
+    dir->lastUsed = ++clock;
+}
+
+void Mounted_Tree::endCommand(Directory* current)
+{
+    for (File_Entry* file : files)
+    {
+        file->~File_Entry();
+        deallocate(file);
+    }
+    files.clear();
+
+    size_t usage = getMemoryUsage();
+    if (usage <= budget)
+        return;
+
+    // Only directories without loaded children can go, so parent pointers below never dangle;
+    // evicting a leaf can make its parent one, hence the repeated passes
+    unordered_map<const Directory*, int> loadedChildren;
+    for (Directory* dir : directories)
+    {
+        if (dir->parent != nullptr)
+            loadedChildren[dir->parent]++;
+    }
+    vector<Directory*> pinned;
+    for (Directory* dir = current; dir != nullptr; dir = dir->parent)
+        pinned.push_back(dir);
+    vector<Directory*> candidates;
+    for (Directory* dir : directories)
+    {
+        if (dir != root && find(pinned.begin(), pinned.end(), dir) == pinned.end())
+            candidates.push_back(dir);
+    }
+    sort(candidates.begin(), candidates.end(), [](const Directory* a, const Directory* b) { return a->lastUsed < b->lastUsed; });
+
+    bool progress = true;
+    while (usage > budget && progress)
+    {
+        progress = false;
+        for (Directory*& dir : candidates)
+        {
+            if (dir == nullptr || loadedChildren[dir] > 0)
+                continue;
+            usage -= min(usage, dir->getMemoryUsage());
+            loadedChildren[dir->parent]--;
+            evict(dir);
+            dir = nullptr;
+            progress = true;
+            if (usage <= budget)
+                break;
+        }
+    }
+}
+
+void Mounted_Tree::setBudget(size_t bytes)
+{
+    budget = bytes;
+}
+
+size_t Mounted_Tree::getBudget()
+{
+    return budget;
+}
+
+size_t Mounted_Tree::getMemoryUsage()
+{
+    size_t usage = slabs.size() * SLAB_NODES * sizeof(Node);
+    for (const Directory* dir : directories)
+        usage += dir->getMemoryUsage() - sizeof(Directory);
+    return usage;
+}
+
+size_t Mounted_Tree::getLoadedDirectories()
+{
+    return directories.size();
+}
+
+long long Mounted_Tree::getEvictions()
+{
+    return evictions;
+}
+
+void* Mounted_Tree::allocate()
+{
+    if (freeNodes.empty())
+    {
+        slabs.push_back(make_unique<Node[]>(SLAB_NODES));
+        for (size_t i = SLAB_NODES; i-- > 0;)
+            freeNodes.push_back(&slabs.back()[i]);
+    }
+    void* node = freeNodes.back();
+    freeNodes.pop_back();
+    return node;
+}
+
+void Mounted_Tree::deallocate(void* node)
+{
+    freeNodes.push_back(node);
+}
+
+void Mounted_Tree::evict(Directory* dir)
+{
+    // The parent forgets the node, so the next openSubDirectory reads it from disk again
+    dir->flush();
+    dir->parent->detachSubDirectory(dir);
+    releaseDirectory(dir);
+    evictions++;
+}
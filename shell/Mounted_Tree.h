@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+class Directory;
+class Directory_Entry;
+class File_Entry;
+
+/** Owner of the in-memory directory tree of the mounted volume. Every Directory node, and every File_Entry handed
+    out by the shell, lives in fixed-size slabs owned here. Directories are loaded the first time they are opened
+    (Directory::openSubDirectory) and the least recently used ones are evicted at the end of a command once the loaded
+    tree outgrows its memory budget; unmount releases the whole tree and the slabs in one go. */
+class Mounted_Tree
+{
+public:
+    /** Memory the loaded directories may take before eviction starts, unless set otherwise. */
+    static const size_t DEFAULT_BUDGET = 16 * 1024 * 1024;
+
+    /** Nodes per slab. */
+    static const size_t SLAB_NODES = 64;
+
+    /** Builds the root directory of the volume that is open in Mini_FAT and reads it. */
+    static Directory* mount();
+
+    /** Destroys every node, flushing directories that still hold changes, and frees the slabs. */
+    static void unmount();
+
+    static Directory* getRoot();
+
+    /** Constructs a directory node in the arena. It is not read from disk. */
+    static Directory* createDirectory(const string& name, char attr, int firstCluster, Directory* parent);
+
+    /** Constructs a file node in the arena. File nodes are scratch: they are released at the end of the command. */
+    static File_Entry* createFile(const Directory_Entry& entry, Directory* parent);
+
+    /** Destroys one directory node (its own loaded children must already be gone) and returns its storage. */
+    static void releaseDirectory(Directory* dir);
+
+    /** Records a use of a directory for the eviction order. */
+    static void touch(Directory* dir);
+
+    /** Called at the end of every command: releases the command's file nodes, then evicts the least recently used
+        directories that hold no loaded children until the tree fits its budget. The root, 'current' and the
+        directories above it stay. */
+    static void endCommand(Directory* current);
+
+    static void setBudget(size_t bytes);
+    static size_t getBudget();
+
+    /** Memory taken by the loaded directories, their entries and indexes. */
+    static size_t getMemoryUsage();
+
+    static size_t getLoadedDirectories();
+    static long long getEvictions();
+
+private:
+    /** Storage for one node, big and aligned enough for either kind. */
+    struct Node;
+
+    /** Takes storage for one node, carving a new slab when the free list is empty. */
+    static void* allocate();
+    static void deallocate(void* node);
+
+    /** Unlinks a directory from its parent's side table and destroys it. */
+    static void evict(Directory* dir);
+
+    static vector<unique_ptr<Node[]>> slabs;
+    static vector<void*> freeNodes;
+
+    /** Loaded directories, and the scratch file nodes of the running command. */
+    static vector<Directory*> directories;
+    static vector<File_Entry*> files;
+
+    static Directory* root;
+    static size_t budget;
+    static long long clock;
+    static long long evictions;
+};
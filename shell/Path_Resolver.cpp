@@ -0,0 +1,190 @@
+#include "Path_Resolver.h"
+#include "Directory.h"
+#include "Mounted_Tree.h"
+#include <cctype>
+#include <functional>
+using namespace std;
+
+unordered_map<Path_Resolver::Key, Path_Resolver::Dentry, Path_Resolver::KeyHash> Path_Resolver::dentries;
+list<Path_Resolver::Key> Path_Resolver::recency;
+size_t Path_Resolver::negatives = 0;
+long long Path_Resolver::generation = 0;
+long long Path_Resolver::hits = 0;
+long long Path_Resolver::misses = 0;
+
+size_t Path_Resolver::KeyHash::operator()(const Key& key) const
+{
+    return hash<const void*>()(key.parent) * 31 + hash<string>()(key.name);
+}
+
+// A component like "C:" names a drive
+static bool isDrive(const string& component)
+{
+    return component.size() == 2 && isalpha(static_cast<unsigned char>(component[0])) && component[1] == ':';
+}
+
+Path_Resolver::Result Path_Resolver::resolve(Directory* start, const string& path)
+{
+    Result result;
+    vector<string> components;
+    string component;
+    for (char c : path)
+    {
+        if (c == '\\' || c == '/')
+        {
+            if (!component.empty())
+                components.push_back(component);
+            component.clear();
+        }
+        else
+        {
+            component += c;
+        }
+    }
+    if (!component.empty())
+        components.push_back(component);
+    if (components.empty())
+        return result;
+
+    Directory* current = start;
+    size_t first = 0;
+    if (isDrive(components[0]))
+    {
+        while (current->parent != nullptr)
+            current = current->parent;
+        string drive(1, static_cast<char>(toupper(static_cast<unsigned char>(components[0][0]))));
+        if (drive != current->getDrive())
+        {
+            result.status = Status::WrongDrive;
+            result.at = current;
+            result.component = drive + ":";
+            return result;
+        }
+        first = 1;
+    }
+
+    for (size_t i = first; i < components.size(); i++)
+    {
+        const string& name = components[i];
+        if (name == ".")
+            continue;
+        if (name == "..")
+        {
+            if (current->parent == nullptr)
+            {
+                result.status = Status::AboveRoot;
+                result.at = current;
+                result.component = name;
+                return result;
+            }
+            current = current->parent;
+            continue;
+        }
+        Dentry dentry = lookup(current, name);
+        if (dentry.status != Status::Found)
+        {
+            result.status = dentry.status;
+            result.at = current;
+            result.component = name;
+            return result;
+        }
+        current = dentry.directory;
+    }
+    result.status = Status::Found;
+    result.directory = current;
+    return result;
+}
+
+Path_Resolver::Dentry Path_Resolver::lookup(Directory* dir, const string& name)
+{
+    Key key{ dir, name };
+    auto it = dentries.find(key);
+    if (it != dentries.end())
+    {
+        hits++;
+        recency.splice(recency.begin(), recency, it->second.used);
+        if (it->second.directory != nullptr)
+            Mounted_Tree::touch(it->second.directory);
+        return it->second;
+    }
+
+    // A miss searches the directory (case-sensitively, like every path walk before it) and loads the subdirectory
+    misses++;
+    Dentry dentry{ Status::NotFound, nullptr, {} };
+    int index = dir->searchDirectory(name);
+    if (index != -1)
+    {
+        if (dir->DirOrFiles[index].dir_attr != 0x10)
+        {
+            dentry.status = Status::NotADirectory;
+        }
+        else
+        {
+            dentry.directory = dir->openSubDirectory(index);
+            dentry.status = dentry.directory != nullptr ? Status::Found : Status::NotFound;
+        }
+    }
+
+    if (dentries.size() >= CAPACITY)
+    {
+        auto victim = dentries.find(recency.back());
+        if (victim->second.status != Status::Found)
+            negatives--;
+        dentries.erase(victim);
+        recency.pop_back();
+    }
+    recency.push_front(key);
+    dentry.used = recency.begin();
+    if (dentry.status != Status::Found)
+        negatives++;
+    dentries.emplace(move(key), dentry);
+    return dentry;
+}
+
+void Path_Resolver::entryChanged(const Directory_Entry& entry)
+{
+    if (entry.dir_attr == 0x10)
+    {
+        invalidate();
+        return;
+    }
+    // A new or renamed file can turn a missing name into a file and back; subdirectories are unaffected
+    if (negatives == 0)
+        return;
+    for (auto it = dentries.begin(); it != dentries.end();)
+    {
+        if (it->second.status != Status::Found)
+        {
+            recency.erase(it->second.used);
+            it = dentries.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    negatives = 0;
+}
+
+void Path_Resolver::invalidate()
+{
+    dentries.clear();
+    recency.clear();
+    negatives = 0;
+    generation++;
+}
+
+long long Path_Resolver::getGeneration()
+{
+    return generation;
+}
+
+long long Path_Resolver::getHits()
+{
+    return hits;
+}
+
+long long Path_Resolver::getMisses()
+{
+    return misses;
+}
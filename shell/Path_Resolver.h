@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+class Directory;
+class Directory_Entry;
+
+/** Resolves shell paths to loaded directories for every command. A path is split on '\' or '/'; it starts at the
+    root when its first component is a drive ("C:") and at the given directory otherwise; "." and ".." are followed
+    as they come. Each step goes through a bounded cache of dentries, (directory, name) pairs remembering the
+    subdirectory they lead to or why they lead nowhere, so walking a known path neither searches nor reads a directory. */
+class Path_Resolver
+{
+public:
+    /** Number of dentries kept; the least recently used one goes first. */
+    static const size_t CAPACITY = 1024;
+
+    enum class Status
+    {
+        Found,
+        Empty,          // no components at all
+        NotFound,       // 'component' is not in 'at'
+        NotADirectory,  // 'component' in 'at' is a file
+        AboveRoot,      // ".." at the root
+        WrongDrive      // the path names a drive other than the root's
+    };
+
+    struct Result
+    {
+        Status status = Status::Empty;
+        Directory* directory = nullptr;  // the directory reached, when found
+        Directory* at = nullptr;         // the directory the walk stopped in, when not
+        string component;                // the component that stopped it
+    };
+
+    /** Walks 'path' from 'start' (or from the root for a drive-qualified path). */
+    static Result resolve(Directory* start, const string& path);
+
+    /** Called when an entry is added to, removed from or renamed in a directory. A directory entry drops every
+        cached dentry, since loaded directories may go away; a file entry only drops the negative ones. */
+    static void entryChanged(const Directory_Entry& entry);
+
+    /** Drops every cached dentry. */
+    static void invalidate();
+
+    /** Bumped by every full invalidation; directories compare it with the one their cached full path was built under. */
+    static long long getGeneration();
+
+    static long long getHits();
+    static long long getMisses();
+
+private:
+    struct Key
+    {
+        const Directory* parent;
+        string name;
+        bool operator==(const Key& other) const { return parent == other.parent && name == other.name; }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct Dentry
+    {
+        Status status;
+        Directory* directory;       // the subdirectory, for a positive dentry
+        list<Key>::iterator used;   // position in the recency list
+    };
+
+    /** Takes one step from 'dir' to its subdirectory 'name', through the cache. */
+    static Dentry lookup(Directory* dir, const string& name);
+
+    static unordered_map<Key, Dentry, KeyHash> dentries;
+
+    /** Keys from most to least recently used. */
+    static list<Key> recency;
+
+    /** Number of cached dentries that lead nowhere. */
+    static size_t negatives;
+
+    static long long generation;
+    static long long hits;
+    static long long misses;
+};
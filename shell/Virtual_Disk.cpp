@@ -1,17 +1,121 @@
 #include "Virtual_Disk.h"
+#include "Async_IO.h"
+#include "Cluster_Cache.h"
+#include "Buffer_Pool.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 using namespace std;
 
 // Initialize the static file stream object for the virtual disk
 fstream Virtual_Disk::Disk;
 
+// Image state for the Mapped and Positional backends
+Virtual_Disk::Mode Virtual_Disk::mode = Virtual_Disk::Mode::Stream;
+string Virtual_Disk::diskPath;
+size_t Virtual_Disk::clusterSize = Virtual_Disk::DEFAULT_CLUSTER_SIZE;
+char* Virtual_Disk::mapped = nullptr;
+long long Virtual_Disk::mappedSize = 0;
+long long Virtual_Disk::imageSize = 0;
+#ifdef _WIN32
+void* Virtual_Disk::fileHandle = INVALID_HANDLE_VALUE;
+void* Virtual_Disk::mappingHandle = nullptr;
+#else
+int Virtual_Disk::fd = -1;
+#endif
+
+// A run always fits in one request of the asynchronous engine
+static_assert(Virtual_Disk::RUN_LIMIT <= Async_IO::MAX_BUFFERS, "run larger than an I/O request");
+
+// The mapping grows at least this much at a time so appending clusters does not remap on every write
+static const long long MAPPING_GROWTH = 64 * 1024;
+
+// Returns the slice of 'bytes' that belongs to the i-th cluster of a multi-cluster transfer (the last may be short or empty)
+template <typename T>
+static span<T> clusterSlice(span<T> bytes, size_t i)
+{
+    size_t size = Virtual_Disk::getClusterSize();
+    size_t offset = i * size;
+    if (offset >= bytes.size())
+        return span<T>();
+    return bytes.subspan(offset, min(size, bytes.size() - offset));
+}
+
+// Byte offset of a cluster in the image, computed in 64 bits so large images never wrap around
+static long long clusterOffset(int clusterIndex)
+{
+    return static_cast<long long>(clusterIndex) * static_cast<long long>(Virtual_Disk::getClusterSize());
+}
+
+// Calls visit(first, count) for every run of consecutive cluster indices, capped at RUN_LIMIT clusters
+template <typename Visit>
+static void forEachRun(const vector<int>& clusterIndices, Visit visit)
+{
+    size_t first = 0;
+    while (first < clusterIndices.size())
+    {
+        size_t count = 1;
+        while (first + count < clusterIndices.size() && count < Virtual_Disk::RUN_LIMIT &&
+            clusterIndices[first + count] == clusterIndices[first] + static_cast<int>(count))
+        {
+            count++;
+        }
+        visit(first, count);
+        first += count;
+    }
+}
+
+// Book-keeping shared by the runs of one submitted transfer: the last run to finish releases the padding and calls back
+struct Pending_Transfer
+{
+    size_t runs = 0;
+    bool failed = false;
+    char* tail = nullptr;
+    function<void(bool ok)> done;
+
+    void finishRun()
+    {
+        if (--runs > 0)
+            return;
+        if (tail != nullptr)
+            Buffer_Pool::release(tail);
+        if (done)
+            done(!failed);
+    }
+};
+
 // Functions
-void Virtual_Disk::createOrOpenDisk(const string& path) {
+void Virtual_Disk::createOrOpenDisk(const string& path, Mode requested) {
+    diskPath = path;
+    mode = Mode::Stream;
+    if (requested == Mode::Mapped && openMapping(path)) {
+        mode = Mode::Mapped;
+        return;
+    }
+#ifndef _WIN32
+    if (requested == Mode::Positional && openImage(path)) {
+        mode = Mode::Positional;
+        Async_IO::start(fd);
+        return;
+    }
+#endif
+
     Disk.open(path, ios::in | ios::out | ios::binary);
 
     if (!Disk.is_open()) {
         Disk.open(path, ios::in | ios::out | ios::binary | ios::trunc);
 
-        
+
     }
 }
 
@@ -20,62 +124,503 @@ void Virtual_Disk::createOrOpenDisk(const string& path) {
 
 void Virtual_Disk::writeCluster(const vector<char>& cluster, int clusterIndex)
 {
-    // Move the write pointer to the position of the specified cluster index
-    Disk.seekp(clusterIndex * 1024, ios::beg);
-   
+    writeCluster(span<const char>(cluster), clusterIndex);
+}
 
+vector<char> Virtual_Disk::readCluster(int clusterIndex)
+{
+    // Create a vector to hold the cluster we will read from the disk
+    vector<char> bytes(clusterSize);
 
-    // Write the 1024 bytes of data from the vector to the disk at the current position
-    Disk.write(cluster.data(), 1024);
+    readCluster(clusterIndex, span<char>(bytes));
 
-    // If the write operation fails, display an error
-   
+    // Return the vector containing the data read from the cluster
+    return bytes;
+}
 
-    // Flush the stream to ensure data is written to the disk
-    Disk.flush();
-    
+void Virtual_Disk::writeCluster(span<const char> cluster, int clusterIndex)
+{
+    // Writes are absorbed by the cache and reach the image on eviction or sync
+    if (cluster.size() >= clusterSize)
+    {
+        Cluster_Cache::write(cluster.data(), clusterIndex);
+        return;
+    }
+
+    // The tail of a chain rarely fills its cluster: pad it in a pooled buffer
+    Cluster_Buffer padded;
+    if (!cluster.empty())
+        memcpy(padded.data(), cluster.data(), cluster.size());
+    memset(padded.data() + cluster.size(), 0, clusterSize - cluster.size());
+    Cluster_Cache::write(padded.data(), clusterIndex);
 }
 
-vector<char> Virtual_Disk::readCluster(int clusterIndex)
+void Virtual_Disk::readCluster(int clusterIndex, span<char> out)
 {
-    /*
-    Moves the file read pointer to the beginning of the specified cluster.
-    The cluster is 1024 bytes, and we move the pointer by multiplying the
-    cluster index by 1024 (the size of one cluster).
-    */
-    Disk.seekg(clusterIndex * 1024, ios::beg);
-    
+    // Hot clusters (FAT, root and parent directories) are served from the cache
+    if (out.size() >= clusterSize)
+    {
+        Cluster_Cache::read(out.data(), clusterIndex);
+        return;
+    }
 
-    // Create a vector to hold the 1024 bytes of data we will read from the disk
-    vector<char> bytes(1024);
+    Cluster_Buffer whole;
+    Cluster_Cache::read(whole.data(), clusterIndex);
+    memcpy(out.data(), whole.data(), out.size());
+}
+
+void Virtual_Disk::readClusters(const vector<int>& clusterIndices, span<char> out)
+{
+    // Small transfers are metadata (FAT, directories) and go through the cache like single clusters
+    if (clusterIndices.size() <= Cluster_Cache::ADMIT_LIMIT)
+    {
+        for (size_t i = 0; i < clusterIndices.size(); i++)
+            readCluster(clusterIndices[i], clusterSlice(out, i));
+        return;
+    }
+
+    // Bulk transfers bypass the cache and read every run of adjacent clusters in one request
+    submitReadClusters(clusterIndices, out, nullptr);
+    waitForTransfers();
+}
+
+void Virtual_Disk::writeClusters(const vector<int>& clusterIndices, span<const char> data)
+{
+    if (clusterIndices.size() <= Cluster_Cache::ADMIT_LIMIT)
+    {
+        for (size_t i = 0; i < clusterIndices.size(); i++)
+            writeCluster(clusterSlice(data, i), clusterIndices[i]);
+        return;
+    }
+
+    submitWriteClusters(clusterIndices, data, nullptr);
+    waitForTransfers();
+}
+
+void Virtual_Disk::submitReadClusters(const vector<int>& clusterIndices, span<char> out, function<void(bool ok)> done)
+{
+    auto pending = make_shared<Pending_Transfer>();
+    pending->runs = 1;
+    pending->done = move(done);
+
+    forEachRun(clusterIndices, [&](size_t first, size_t count) {
+        span<char> buffers[RUN_LIMIT];
+        for (size_t i = 0; i < count; i++)
+            buffers[i] = clusterSlice(out, first + i);
+        int firstCluster = clusterIndices[first];
+
+        // Clusters still dirty in the cache are newer than the image
+        auto arrived = [out, first, count, firstCluster, pending](long long result) {
+            if (result < 0)
+            {
+                cout << "Error: Could not read from the virtual disk.\n";
+                pending->failed = true;
+            }
+            for (size_t i = 0; i < count; i++)
+                Cluster_Cache::peek(firstCluster + static_cast<int>(i), clusterSlice(out, first + i));
+            pending->finishRun();
+            };
+
+        pending->runs++;
+#ifndef _WIN32
+        if (mode == Mode::Positional)
+        {
+            Async_IO::submitRead(clusterOffset(firstCluster), span<const span<char>>(buffers, count), arrived);
+            return;
+        }
+#endif
+        readRunFromImage(firstCluster, span<const span<char>>(buffers, count));
+        arrived(0);
+        });
+
+    // Drop the reference held while submitting; with every run already complete this calls back now
+    pending->finishRun();
+}
+
+void Virtual_Disk::submitWriteClusters(const vector<int>& clusterIndices, span<const char> data, function<void(bool ok)> done)
+{
+    auto pending = make_shared<Pending_Transfer>();
+    pending->runs = 1;
+    pending->done = move(done);
+
+    forEachRun(clusterIndices, [&](size_t first, size_t count) {
+        span<const char> buffers[RUN_LIMIT];
+        for (size_t i = 0; i < count; i++)
+        {
+            // Only the tail of the data can be short; it is padded so the rest of its cluster reads as zeros,
+            // in a pooled buffer that stays alive until the transfer completes
+            span<const char> slice = clusterSlice(data, first + i);
+            if (slice.size() < clusterSize)
+            {
+                pending->tail = Buffer_Pool::acquire();
+                memcpy(pending->tail, slice.data(), slice.size());
+                memset(pending->tail + slice.size(), 0, clusterSize - slice.size());
+                slice = span<const char>(pending->tail, clusterSize);
+            }
+            buffers[i] = slice;
+
+            // Keep any cached copy in step with what is about to be on disk
+            Cluster_Cache::refresh(clusterIndices[first + i], slice.data());
+        }
+        int firstCluster = clusterIndices[first];
+
+        pending->runs++;
+#ifndef _WIN32
+        if (mode == Mode::Positional)
+        {
+            imageSize = max(imageSize, clusterOffset(firstCluster + static_cast<int>(count)));
+            Async_IO::submitWrite(clusterOffset(firstCluster), span<const span<const char>>(buffers, count),
+                [pending](long long result) {
+                    if (result < 0)
+                    {
+                        cout << "Error: Could not write to the virtual disk.\n";
+                        pending->failed = true;
+                    }
+                    pending->finishRun();
+                });
+            return;
+        }
+#endif
+        writeRunToImage(firstCluster, span<const span<const char>>(buffers, count));
+        pending->finishRun();
+        });
+
+    pending->finishRun();
+}
+
+void Virtual_Disk::waitForTransfers()
+{
+#ifndef _WIN32
+    Async_IO::drain();
+#endif
+}
+
+bool Virtual_Disk::waitForAnyTransfer()
+{
+#ifndef _WIN32
+    return Async_IO::waitForAny();
+#else
+    return false;
+#endif
+}
+
+void Virtual_Disk::writeToImage(const char* cluster, int clusterIndex)
+{
+    span<const char> buffer(cluster, clusterSize);
+    writeRunToImage(clusterIndex, span<const span<const char>>(&buffer, 1));
+}
+
+void Virtual_Disk::readFromImage(char* bytes, int clusterIndex)
+{
+    span<char> buffer(bytes, clusterSize);
+    readRunFromImage(clusterIndex, span<const span<char>>(&buffer, 1));
+}
+
+void Virtual_Disk::writeRunToImage(int firstCluster, span<const span<const char>> buffers)
+{
+    // Offsets are computed in 64 bits so large images never wrap around
+    long long offset = clusterOffset(firstCluster);
+    long long end = clusterOffset(firstCluster + static_cast<int>(buffers.size()) - 1) + static_cast<long long>(buffers.back().size());
+
+    if (mode == Mode::Mapped)
+    {
+        if (end <= mappedSize || growMapping(end))
+        {
+            for (const auto& buffer : buffers)
+            {
+                memcpy(mapped + offset, buffer.data(), buffer.size());
+                offset += static_cast<long long>(clusterSize);
+            }
+            imageSize = max(imageSize, end);
+            return;
+        }
+
+        // The image could not be extended in place: carry on through the stream
+        fallBackToStream();
+    }
+
+#ifndef _WIN32
+    if (mode == Mode::Positional)
+    {
+        // Earlier requests may still touch the same clusters, so the run waits for them and then for itself
+        Async_IO::drain();
+        Async_IO::submitWrite(offset, buffers, [](long long result) {
+            if (result < 0)
+                cout << "Error: Could not write to the virtual disk.\n";
+            });
+        Async_IO::drain();
+        imageSize = max(imageSize, end);
+        return;
+    }
+#endif
+
+    // Move the write pointer to the start of the run once, then write its clusters back to back
+    Disk.seekp(offset, ios::beg);
+    for (const auto& buffer : buffers)
+        Disk.write(buffer.data(), static_cast<streamsize>(buffer.size()));
+}
+
+void Virtual_Disk::readRunFromImage(int firstCluster, span<const span<char>> buffers)
+{
+    long long offset = clusterOffset(firstCluster);
+
+    if (mode == Mode::Mapped)
+    {
+        // Bytes past the end of the image read back as zeros, like a freshly formatted cluster
+        for (const auto& buffer : buffers)
+        {
+            memset(buffer.data(), 0, buffer.size());
+            if (offset < mappedSize)
+                memcpy(buffer.data(), mapped + offset, static_cast<size_t>(min<long long>(static_cast<long long>(buffer.size()), mappedSize - offset)));
+            offset += static_cast<long long>(clusterSize);
+        }
+        return;
+    }
+
+#ifndef _WIN32
+    if (mode == Mode::Positional)
+    {
+        // Whatever lies past the end of the image reads as zeros, and so does a run that could not be read, rather
+        // than whatever the buffers held
+        Async_IO::drain();
+        Async_IO::submitRead(offset, buffers, [buffers](long long result) {
+            if (result >= 0)
+                return;
+            cout << "Error: Could not read from the virtual disk.\n";
+            for (const auto& buffer : buffers)
+                memset(buffer.data(), 0, buffer.size());
+            });
+        Async_IO::drain();
+        return;
+    }
+#endif
 
     /*
-    Reads the 1024 bytes of data starting from the current position of the read pointer
-    and fills the 'bytes' vector with the data.
+    Moves the file read pointer to the beginning of the run once.
+    The run starts at its first cluster index multiplied by the
+    cluster size recorded in the superblock.
     */
-    Disk.read(bytes.data(), 1024);
+    Disk.seekg(offset, ios::beg);
 
-    // Check if the read operation was successful
-    
-    // Return the vector containing the data read from the cluster
-    return bytes;
+    for (const auto& buffer : buffers)
+    {
+        // A cluster that was never written lies past the end of the file: it reads as zeros
+        // and the stream is reset so later writes are not refused
+        Disk.read(buffer.data(), static_cast<streamsize>(buffer.size()));
+        if (!Disk)
+        {
+            memset(buffer.data() + Disk.gcount(), 0, buffer.size() - static_cast<size_t>(Disk.gcount()));
+            Disk.clear();
+            Disk.seekg(0, ios::end);
+        }
+    }
+}
+
+void Virtual_Disk::setClusterSize(size_t size)
+{
+    if (size == clusterSize)
+        return;
+
+    // Cached clusters and pooled buffers are sized for the old geometry
+    waitForTransfers();
+    Cluster_Cache::clear();
+    Buffer_Pool::setBufferSize(size);
+    clusterSize = size;
+}
+
+size_t Virtual_Disk::getClusterSize()
+{
+    return clusterSize;
 }
 
 bool Virtual_Disk::isNew()
 {
+    if (mode != Mode::Stream)
+        return imageSize == 0;
+
     // Move the file pointer to the end of the file to determine its size
     Disk.seekg(0, ios::end);
 
     // Get the current position of the read pointer, which represents the size of the file
-    int size = static_cast<int>(Disk.tellg());
+    long long size = static_cast<long long>(Disk.tellg());
 
     // If the file size is zero, it means the disk is new (empty)
     return (size == 0);
 }
 
+void Virtual_Disk::sync(bool wait)
+{
+    Cluster_Cache::flush();
+    if (mode == Mode::Stream) {
+        Disk.flush();
+        return;
+    }
+#ifndef _WIN32
+    if (mode == Mode::Positional) {
+        Async_IO::drain();
+        if (wait)
+            fsync(fd);
+        return;
+    }
+#endif
+    if (mapped == nullptr)
+        return;
+#ifdef _WIN32
+    FlushViewOfFile(mapped, 0);
+    if (wait)
+        FlushFileBuffers(static_cast<HANDLE>(fileHandle));
+#else
+    msync(mapped, static_cast<size_t>(mappedSize), wait ? MS_SYNC : MS_ASYNC);
+#endif
+}
+
+Virtual_Disk::Mode Virtual_Disk::getMode()
+{
+    return mode;
+}
+
 void Virtual_Disk::closeDisk()
 {
-    if (Disk.is_open()) {
+    // Nothing may stay behind in the cache once the image is gone
+    Cluster_Cache::clear();
+
+    if (mode != Mode::Stream) {
+        sync(true);
+#ifndef _WIN32
+        if (mode == Mode::Positional)
+            Async_IO::stop();
+#endif
+        releaseImage();
+        mode = Mode::Stream;
+    }
+    else if (Disk.is_open()) {
         Disk.close();
     }
-}
\ No newline at end of file
+
+    // Every transfer has finished and the cache has let go of its buffers, so the pool can be emptied
+    Buffer_Pool::clear();
+}
+
+bool Virtual_Disk::openImage(const string& path)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return false;
+    }
+    fileHandle = file;
+    imageSize = size.QuadPart;
+#else
+    fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    imageSize = st.st_size;
+#endif
+    return true;
+}
+
+bool Virtual_Disk::openMapping(const string& path)
+{
+    if (!openImage(path))
+        return false;
+
+    // An empty image has nothing to map yet; the first write grows it
+    if (imageSize > 0 && !mapImage(imageSize)) {
+        releaseImage();
+        return false;
+    }
+    return true;
+}
+
+bool Virtual_Disk::mapImage(long long size)
+{
+#ifdef _WIN32
+    // Creating a mapping larger than the file extends the file to that size
+    HANDLE mapping = CreateFileMappingA(static_cast<HANDLE>(fileHandle), nullptr, PAGE_READWRITE,
+        static_cast<DWORD>(size >> 32), static_cast<DWORD>(size & 0xFFFFFFFF), nullptr);
+    if (mapping == nullptr)
+        return false;
+    void* view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, static_cast<SIZE_T>(size));
+    if (view == nullptr) {
+        CloseHandle(mapping);
+        return false;
+    }
+    mappingHandle = mapping;
+#else
+    void* view = mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (view == MAP_FAILED)
+        return false;
+#endif
+    mapped = static_cast<char*>(view);
+    mappedSize = size;
+    return true;
+}
+
+void Virtual_Disk::unmapImage()
+{
+    if (mapped == nullptr)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(mapped);
+    CloseHandle(static_cast<HANDLE>(mappingHandle));
+    mappingHandle = nullptr;
+#else
+    munmap(mapped, static_cast<size_t>(mappedSize));
+#endif
+    mapped = nullptr;
+    mappedSize = 0;
+}
+
+bool Virtual_Disk::growMapping(long long minSize)
+{
+    // Grow geometrically so a long run of appends costs a logarithmic number of remaps
+    long long newSize = max(minSize, max(mappedSize * 2, MAPPING_GROWTH));
+    unmapImage();
+#ifndef _WIN32
+    if (ftruncate(fd, static_cast<off_t>(newSize)) != 0)
+        return false;
+#endif
+    return mapImage(newSize);
+}
+
+void Virtual_Disk::releaseImage()
+{
+    unmapImage();
+#ifdef _WIN32
+    if (fileHandle != INVALID_HANDLE_VALUE) {
+        // Trim the slack left by growMapping so the image keeps its logical size
+        LARGE_INTEGER size;
+        size.QuadPart = imageSize;
+        SetFilePointerEx(static_cast<HANDLE>(fileHandle), size, nullptr, FILE_BEGIN);
+        SetEndOfFile(static_cast<HANDLE>(fileHandle));
+        CloseHandle(static_cast<HANDLE>(fileHandle));
+        fileHandle = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (fd >= 0) {
+        // Trim the slack left by growMapping so the image keeps its logical size
+        if (ftruncate(fd, static_cast<off_t>(imageSize)) != 0)
+            cout << "Error: Could not restore the size of the virtual disk image.\n";
+        close(fd);
+        fd = -1;
+    }
+#endif
+}
+
+void Virtual_Disk::fallBackToStream()
+{
+    releaseImage();
+    mode = Mode::Stream;
+    Disk.open(diskPath, ios::in | ios::out | ios::binary);
+}
@@ -1,6 +1,8 @@
 #pragma once
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <span>
 #include <string>
 #include <vector>
 using namespace std;
@@ -9,23 +11,125 @@ using namespace std;
 class Virtual_Disk
 {
 public:
-    /** Creates or opens a virtual disk file. If not exists, creates it. */
-    static void createOrOpenDisk(const string& path);
+    /** Backends the disk can serve clusters from: the buffered file stream, a memory mapping of the image,
+        or positional vectored I/O on a file descriptor (POSIX only). */
+    enum class Mode { Stream, Mapped, Positional };
 
-    /** Writes a 1024-byte cluster to the virtual disk at the specified index. */
+    /** Longest run of adjacent clusters moved by a single backend call. */
+    static const size_t RUN_LIMIT = 64;
+
+    /** Cluster size used until the file system reads the real one from the superblock. */
+    static const size_t DEFAULT_CLUSTER_SIZE = 1024;
+
+    /** Creates or opens a virtual disk file. If not exists, creates it. Falls back to Stream if the requested backend is unavailable. */
+    static void createOrOpenDisk(const string& path, Mode mode = Mode::Stream);
+
+    /** Writes a cluster to the virtual disk at the specified index. */
     static void writeCluster(const vector<char>& cluster, int clusterIndex);
 
-    /** Reads a 1024-byte cluster from the virtual disk at the specified index. */
+    /** Reads a cluster from the virtual disk at the specified index. */
     static vector<char> readCluster(int clusterIndex);
 
+    /** Writes a cluster from a caller-owned span; a span shorter than a cluster is zero-padded. Does not allocate. */
+    static void writeCluster(span<const char> cluster, int clusterIndex);
+
+    /** Reads a cluster into a caller-owned span; a span shorter than a cluster receives the leading bytes. Does not allocate. */
+    static void readCluster(int clusterIndex, span<char> out);
+
+    /** Reads the listed clusters into consecutive cluster-sized slices of 'out' (the last may be short). Adjacent indices are read as one run. */
+    static void readClusters(const vector<int>& clusterIndices, span<char> out);
+
+    /** Writes consecutive cluster-sized slices of 'data' to the listed clusters (the last may be short and is zero-padded).
+        Adjacent indices are written as one run. */
+    static void writeClusters(const vector<int>& clusterIndices, span<const char> data);
+
+    /** Queues a read of the listed clusters into 'out', laid out as in readClusters, without going through the cache;
+        'done' runs once every cluster has arrived and 'out' must stay alive until then. Only the Positional backend
+        overlaps the I/O with the caller, the other backends complete before returning. 'done' is told whether every
+        run succeeded; after a failure the bytes in 'out' must not be used. */
+    static void submitReadClusters(const vector<int>& clusterIndices, span<char> out, function<void(bool ok)> done);
+
+    /** Queues a write of 'data' to the listed clusters, laid out as in writeClusters; same rules as submitReadClusters.
+        Transfers queued together must not overlap. */
+    static void submitWriteClusters(const vector<int>& clusterIndices, span<const char> data, function<void(bool ok)> done);
+
+    /** Blocks until every queued cluster transfer has completed and its callback has run. */
+    static void waitForTransfers();
+
+    /** Blocks until some queued I/O has completed and its callbacks have run, so a caller keeping a bounded number of
+        transfers queued can reuse the buffer of one that finished; false when nothing is queued. */
+    static bool waitForAnyTransfer();
+
+    /** Sets the cluster size every offset is computed from. Waits for queued transfers and empties the cache first. */
+    static void setClusterSize(size_t size);
+
+    /** Returns the size of a cluster in bytes. */
+    static size_t getClusterSize();
+
     /** Checks if the virtual disk file is new (empty). */
     static bool isNew();
 
+    /** Writes dirty cached clusters back and pushes them to the image file; waits for the OS when 'wait' is set. */
+    static void sync(bool wait = true);
+
+    /** Returns the backend actually serving the disk. */
+    static Mode getMode();
+
     static void closeDisk();
 
-    
+
 
 private:
+    friend class Cluster_Cache;
+
+    /** Backend I/O used by the cluster cache: copies one cluster between 'bytes' and the image. */
+    static void readFromImage(char* bytes, int clusterIndex);
+    static void writeToImage(const char* bytes, int clusterIndex);
+
+    /** Backend I/O for a run of adjacent clusters starting at 'firstCluster', one buffer per cluster (at most RUN_LIMIT). */
+    static void readRunFromImage(int firstCluster, span<const span<char>> buffers);
+    static void writeRunToImage(int firstCluster, span<const span<const char>> buffers);
+
     /** File stream for the virtual disk, opened in read/write binary mode. */
     static fstream Disk;
+
+    /** Backend selected when the disk was opened, and the image it was opened from. */
+    static Mode mode;
+    static string diskPath;
+
+    /** Size of one cluster in bytes, as recorded in the superblock. */
+    static size_t clusterSize;
+
+    /** Base address and length of the mapping, and the logical image size (the mapping grows ahead of it). */
+    static char* mapped;
+    static long long mappedSize;
+    static long long imageSize;
+
+#ifdef _WIN32
+    static void* fileHandle;
+    static void* mappingHandle;
+#else
+    static int fd;
+#endif
+
+    /** Opens the image file for the Mapped and Positional backends and records its size. */
+    static bool openImage(const string& path);
+
+    /** Opens the image and maps it; returns false if any step fails so the caller can fall back to Stream. */
+    static bool openMapping(const string& path);
+
+    /** Extends the image file and remaps it so that at least 'minSize' bytes are addressable. */
+    static bool growMapping(long long minSize);
+
+    /** Drops the current view of the image without touching the file. */
+    static void unmapImage();
+
+    /** Maps 'size' bytes of the already opened image. */
+    static bool mapImage(long long size);
+
+    /** Unmaps the image, trims it back to its logical size and closes it. */
+    static void releaseImage();
+
+    /** Abandons the mapping and reopens the image through the file stream. */
+    static void fallBackToStream();
 };
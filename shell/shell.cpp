@@ -1,30 +1,68 @@
 #include "Virtual_Disk.h"
 #include "Mini_FAT.h"
 #include "Directory.h"
+#include "Dedup_Table.h"
+#include "Mounted_Tree.h"
 #include "Directory_Entry.h"
 #include "File_Entry.h"
 #include "Tokenizer.h"
 #include "Parser.h"
 #include "CommandProcessor.h"
 #include "Converter.h"
+#include <cstdlib>
 #include <iostream>
+#include <sstream>
 #include <vector>
 #include <string>
 using namespace std;
 
-int main()
+int main(int argc, char* argv[])
 {
     // Path to the virtual disk file
-    string diskPath = "virtual_disk.bin";
+    string diskPath = argc > 1 ? argv[1] : "virtual_disk.bin";
 
-    // Initialize or open the virtual disk and FAT
-    Mini_FAT::initialize_Or_Open_FileSystem(diskPath);
+    // Geometry used if the disk has to be formatted: shell [disk] [cluster size] [cluster count] [tree budget in KiB]
+    // [options] [backend], where the options are "compress", "dedup" or both joined by a comma, and the backend is
+    // "mapped" (the default), "positional" or "stream"
+    int clusterSize = argc > 2 ? atoi(argv[2]) : Mini_FAT::LEGACY_CLUSTER_SIZE;
+    int clusterCount = argc > 3 ? atoi(argv[3]) : Mini_FAT::LEGACY_CLUSTER_COUNT;
+    int features = 0;
+    if (argc > 5)
+    {
+        stringstream options(argv[5]);
+        string option;
+        while (getline(options, option, ','))
+        {
+            if (option == "compress")
+                features |= Mini_FAT::FEATURE_COMPRESSION;
+            else if (option == "dedup")
+                features |= Mini_FAT::FEATURE_DEDUPLICATION;
+        }
+    }
+
+    // Backend the disk is served from; one the platform cannot provide falls back to the stream
+    Virtual_Disk::Mode mode = Virtual_Disk::Mode::Mapped;
+    if (argc > 6)
+    {
+        string backend = argv[6];
+        if (backend == "positional")
+            mode = Virtual_Disk::Mode::Positional;
+        else if (backend == "stream")
+            mode = Virtual_Disk::Mode::Stream;
+        else if (backend != "mapped")
+            cout << "Error: Unknown disk backend '" << backend << "'; using mapped.\n";
+    }
 
-    // Create the root directory "C:\"
-    Directory* rootDir = new Directory("C:", 0x10, 0, nullptr);
-    rootDir->name = "C:";
+    // Memory the loaded directory tree may use before directories are evicted
+    if (argc > 4 && atoll(argv[4]) > 0)
+        Mounted_Tree::setBudget(static_cast<size_t>(atoll(argv[4])) * 1024);
+
+    // Initialize or open the virtual disk and FAT
+    Mini_FAT::initialize_Or_Open_FileSystem(diskPath, mode, clusterSize, clusterCount, features);
+    Dedup_Table::load();
 
-    rootDir->readDirectory(); 
+    // Mount the directory tree, starting from the root directory "C:\"
+    Directory* rootDir = Mounted_Tree::mount();
 
     // Initialize the current directory to root
     Directory* currentDir = rootDir;
@@ -46,9 +84,9 @@ int main()
         cmdProcessor.processCommand(input, isRunning);
     }
 
-    // Cleanup: Delete the root directory (which recursively deletes subdirectories)
+    // Cleanup: Release the whole directory tree, writing what it still holds, then close the disk
+    Mounted_Tree::unmount();
     Mini_FAT::CloseTheSystem();
-    delete rootDir;
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,183 @@
+#include "Tests.h"
+#include "Virtual_Disk.h"
+#include "Cluster_Cache.h"
+#include "Buffer_Pool.h"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+using namespace std;
+
+// Checks the allocation contract of the cluster I/O API: once the buffer pool and the cache are warm, reading and
+// writing clusters does not touch the heap, a bulk transfer allocates per run of clusters at most (never per
+// cluster), and closing the disk hands every pooled buffer back.
+
+static long long allocations = 0;
+static long long alignedInUse = 0;
+
+static void* allocate(size_t size)
+{
+    allocations++;
+    if (void* p = malloc(size > 0 ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+
+static void* allocateAligned(size_t size, align_val_t alignment)
+{
+    allocations++;
+    alignedInUse++;
+#ifdef _WIN32
+    void* p = _aligned_malloc(size > 0 ? size : 1, static_cast<size_t>(alignment));
+#else
+    void* p = nullptr;
+    if (posix_memalign(&p, static_cast<size_t>(alignment), size > 0 ? size : 1) != 0)
+        p = nullptr;
+#endif
+    if (p == nullptr)
+        throw bad_alloc();
+    return p;
+}
+
+static void freeAligned(void* p)
+{
+    if (p == nullptr)
+        return;
+    alignedInUse--;
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void* operator new(size_t size, align_val_t alignment) { return allocateAligned(size, alignment); }
+void* operator new[](size_t size, align_val_t alignment) { return allocateAligned(size, alignment); }
+void operator delete(void* p, align_val_t) noexcept { freeAligned(p); }
+void operator delete[](void* p, align_val_t) noexcept { freeAligned(p); }
+void operator delete(void* p, size_t, align_val_t) noexcept { freeAligned(p); }
+void operator delete[](void* p, size_t, align_val_t) noexcept { freeAligned(p); }
+
+static void check(const string& name, long long measured, long long allowed)
+{
+    Tests::check(name, measured <= allowed, to_string(measured) + " allocation(s), " + to_string(allowed) + " allowed");
+}
+
+static void testMode(Virtual_Disk::Mode mode, const string& modeName, const string& path)
+{
+    const size_t clusterSize = Virtual_Disk::DEFAULT_CLUSTER_SIZE;
+    const int BULK_CLUSTERS = 256;
+    const long long BULK_RUNS = (BULK_CLUSTERS + Virtual_Disk::RUN_LIMIT - 1) / Virtual_Disk::RUN_LIMIT;
+
+    remove(path.c_str());
+    Virtual_Disk::createOrOpenDisk(path, mode);
+
+    // Everything the calls need is set up before counting starts
+    vector<char> cluster(clusterSize, 'a');
+    vector<char> half(clusterSize / 2, 'b');
+    vector<int> small;
+    for (int i = 0; i < static_cast<int>(Cluster_Cache::ADMIT_LIMIT); i++)
+        small.push_back(200 + i);
+    vector<char> smallData(small.size() * clusterSize, 'c');
+    vector<int> bulk;
+    for (int i = 0; i < BULK_CLUSTERS; i++)
+        bulk.push_back(1000 + i);
+    vector<char> bulkData(bulk.size() * clusterSize, 'd');
+
+    // Warm up: the image reaches its full size, the cache fills and the pool holds its peak of buffers
+    for (int i = 0; i < Cluster_Cache::CAPACITY * 2; i++)
+    {
+        Virtual_Disk::writeCluster(span<const char>(cluster), i);
+        Virtual_Disk::readCluster(i, span<char>(cluster));
+    }
+    Virtual_Disk::writeCluster(span<const char>(half), 0);
+    Virtual_Disk::readCluster(0, span<char>(half));
+    Virtual_Disk::writeClusters(small, span<const char>(smallData));
+    Virtual_Disk::readClusters(small, span<char>(smallData));
+    Virtual_Disk::writeClusters(bulk, span<const char>(bulkData));
+    Virtual_Disk::readClusters(bulk, span<char>(bulkData));
+
+    long long before = allocations;
+    for (int i = 0; i < 1000; i++)
+    {
+        int index = (i * 7) % (Cluster_Cache::CAPACITY * 3);
+        Virtual_Disk::writeCluster(span<const char>(cluster), index);
+        Virtual_Disk::readCluster(index, span<char>(cluster));
+        Virtual_Disk::writeCluster(span<const char>(half), index);
+        Virtual_Disk::readCluster(index, span<char>(half));
+    }
+    // The count is taken before the check's own strings are built
+    long long used = allocations - before;
+    check(modeName + " readCluster/writeCluster", used, 0);
+
+    before = allocations;
+    for (int i = 0; i < 100; i++)
+    {
+        Virtual_Disk::writeClusters(small, span<const char>(smallData));
+        Virtual_Disk::readClusters(small, span<char>(smallData));
+    }
+    used = allocations - before;
+    check(modeName + " cached readClusters/writeClusters", used, 0);
+
+    before = allocations;
+    Virtual_Disk::readClusters(bulk, span<char>(bulkData));
+    used = allocations - before;
+    check(modeName + " bulk readClusters of " + to_string(BULK_CLUSTERS) + " clusters", used, BULK_RUNS + 1);
+
+    before = allocations;
+    Virtual_Disk::writeClusters(bulk, span<const char>(bulkData));
+    used = allocations - before;
+    check(modeName + " bulk writeClusters of " + to_string(BULK_CLUSTERS) + " clusters", used, BULK_RUNS + 1);
+
+    Virtual_Disk::closeDisk();
+    long long left = alignedInUse;
+    check(modeName + " pooled buffers left after closeDisk", left, 0);
+    remove(path.c_str());
+}
+
+// A buffer still lent out when the pool is cleared is freed when it comes back, not pooled again, even when the
+// buffer size changed in between
+static void testReleaseAfterClear()
+{
+    size_t size = Buffer_Pool::getBufferSize();
+    Buffer_Pool::clear();
+    long long before = alignedInUse;
+    char* held = Buffer_Pool::acquire();
+    char* pooled = Buffer_Pool::acquire();
+    Buffer_Pool::release(pooled);
+    Buffer_Pool::clear();
+    Buffer_Pool::setBufferSize(size * 2);
+    Buffer_Pool::release(held);
+    long long left = alignedInUse - before;
+    Tests::check("buffer released after clear", left == 0, to_string(left) + " buffer(s) left");
+
+    // Buffers taken after the clear are pooled as before
+    held = Buffer_Pool::acquire();
+    Buffer_Pool::release(held);
+    before = allocations;
+    held = Buffer_Pool::acquire();
+    Buffer_Pool::release(held);
+    long long used = allocations - before;
+    check("buffer acquired after clear is pooled", used, 0);
+    Buffer_Pool::clear();
+    Buffer_Pool::setBufferSize(size);
+}
+
+void Tests::clusterIoAllocations(const string& path)
+{
+    testMode(Virtual_Disk::Mode::Stream, "Stream", path);
+    testMode(Virtual_Disk::Mode::Mapped, "Mapped", path);
+    testMode(Virtual_Disk::Mode::Positional, "Positional", path);
+    testReleaseAfterClear();
+}
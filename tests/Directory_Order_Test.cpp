@@ -0,0 +1,92 @@
+#include "Tests.h"
+#include "CommandProcessor.h"
+#include "Dedup_Table.h"
+#include "Mini_FAT.h"
+#include "Mounted_Tree.h"
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Deleting entries from a flat directory keeps the others in the order they were created, both in the listing
+// of the session that deleted them and after the disk is mounted again.
+
+// Runs one shell command, answering 'answers' to its prompts, and returns what it printed
+static string runCommand(CommandProcessor& processor, const string& command, const string& answers = "")
+{
+    ostringstream output;
+    istringstream input(answers);
+    streambuf* savedOut = cout.rdbuf(output.rdbuf());
+    streambuf* savedIn = cin.rdbuf(input.rdbuf());
+    bool running = true;
+    processor.processCommand(command, running);
+    cout.rdbuf(savedOut);
+    cin.rdbuf(savedIn);
+    return output.str();
+}
+
+// Names 'dir' listed, in its order, keeping only those in 'names'
+static vector<string> listed(CommandProcessor& processor, const vector<string>& names)
+{
+    vector<string> order;
+    istringstream lines(runCommand(processor, "dir"));
+    string line;
+    while (getline(lines, line))
+    {
+        string first = line.substr(0, line.find(' '));
+        for (const string& name : names)
+        {
+            if (first == name)
+                order.push_back(name);
+        }
+    }
+    return order;
+}
+
+static string joined(const vector<string>& names)
+{
+    string text;
+    for (const string& name : names)
+        text += (text.empty() ? "" : " ") + name;
+    return text;
+}
+
+void Tests::directoryOrder(const string& path)
+{
+    const vector<string> created = { "a.txt", "b.txt", "c.txt", "d.txt", "e.txt" };
+    const vector<string> expected = { "b.txt", "d.txt", "e.txt" };
+
+    for (int features : { 0, Mini_FAT::FEATURE_DEDUPLICATION })
+    {
+        string volume = features == 0 ? "plain" : "dedup";
+        remove(path.c_str());
+        Mini_FAT::initialize_Or_Open_FileSystem(path, Virtual_Disk::Mode::Positional, 1024, 1024, features);
+        Dedup_Table::load();
+        Directory* current = Mounted_Tree::mount();
+        {
+            CommandProcessor processor(&current);
+            for (const string& name : created)
+                runCommand(processor, "echo " + name);
+            runCommand(processor, "del a.txt", "y\n");
+            runCommand(processor, "del c.txt", "y\n");
+            vector<string> order = listed(processor, created);
+            check(volume + " dir order after deletes", order == expected, joined(order));
+        }
+        Mounted_Tree::unmount();
+        Mini_FAT::CloseTheSystem();
+
+        Mini_FAT::initialize_Or_Open_FileSystem(path, Virtual_Disk::Mode::Positional);
+        Dedup_Table::load();
+        current = Mounted_Tree::mount();
+        {
+            CommandProcessor processor(&current);
+            vector<string> order = listed(processor, created);
+            check(volume + " dir order after remount", order == expected, joined(order));
+        }
+        Mounted_Tree::unmount();
+        Mini_FAT::CloseTheSystem();
+    }
+    remove(path.c_str());
+}
@@ -0,0 +1,37 @@
+#include "Tests.h"
+#include <iostream>
+#include <string>
+using namespace std;
+
+int Tests::failures = 0;
+
+void Tests::check(const string& name, bool passed, const string& detail)
+{
+    cout << (passed ? "PASS " : "FAIL ") << name << ": " << detail << "\n";
+    if (!passed)
+        failures++;
+}
+
+int Tests::getFailures()
+{
+    return failures;
+}
+
+// Runs the checks: tests [all | alloc | dirorder] [scratch disk path]
+int main(int argc, char* argv[])
+{
+    string which = argc > 1 ? argv[1] : "all";
+    string path = argc > 2 ? argv[2] : "tests_disk.bin";
+    bool all = which == "all";
+    if (!all && which != "alloc" && which != "dirorder")
+    {
+        cout << "Usage: tests [all | alloc | dirorder] [scratch disk path]\n";
+        return 1;
+    }
+    if (all || which == "alloc")
+        Tests::clusterIoAllocations(path);
+    if (all || which == "dirorder")
+        Tests::directoryOrder(path);
+    cout << (Tests::getFailures() == 0 ? "All checks passed.\n" : "Some checks failed.\n");
+    return Tests::getFailures() == 0 ? 0 : 1;
+}
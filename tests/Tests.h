@@ -0,0 +1,22 @@
+#pragma once
+#include <string>
+using namespace std;
+
+/** Checks run by the tests program (see Tests.cpp for its arguments); each prints a PASS or FAIL line per check. */
+class Tests
+{
+public:
+    /** Allocations made by the cluster I/O API on every backend once the pool and the cache are warm. */
+    static void clusterIoAllocations(const string& path);
+
+    /** Order 'dir' lists a directory in after entries are deleted, in the same session and after a remount. */
+    static void directoryOrder(const string& path);
+
+    /** Prints the outcome of one check, 'detail' saying what was measured, and counts it if it failed. */
+    static void check(const string& name, bool passed, const string& detail);
+
+    static int getFailures();
+
+private:
+    static int failures;
+};